@@ -0,0 +1,298 @@
+#ifndef COMMAND_FORMAT_H
+#define COMMAND_FORMAT_H
+
+// Binary /commands format (version 1).
+//
+// No Arduino dependencies, so the firmware and host tools share it.
+//
+//   header (HEADER_SIZE bytes, little endian)
+//     "VPB1"        magic
+//     u8  version   VERSION
+//     u8  flags     0
+//     u16 reserved  0
+//     i32 totalDistance, height          0.01 mm
+//     i32 minX, minY, maxX, maxY         bounding box of all points, 0.01 mm
+//     u32 count                          commands after the header
+//     u32 reserved  0
+//   records
+//     OP_PEN_UP / OP_PEN_DOWN
+//     OP_MOVE      dx dy                 end minus the previous point
+//     OP_ARC_CW/CCW dx dy i j            i j: center minus the start point
+//
+// Coordinates are integers in UNIT mm; every operand is a zig-zag varint, so
+// the short moves of a drawing take 1-2 bytes per axis. Positions are summed
+// as integers, so there is no drift over the file.
+//
+// Compiled variant (magic "VPC1", tools/beltcompile): the IK is solved on a
+// host and the records carry belt step targets, so the device does none.
+//   header: the fields above, then
+//     Machine (MACHINE_SIZE bytes)       what the steps were computed for
+//     i32 startX, startY                 first point, 0.01 mm
+//     i32 startL, startR                 belt steps at the first point
+//   records
+//     OP_PEN_UP / OP_PEN_DOWN
+//     OP_BELT  dx dy dL dR vNom vJunction
+//              dx dy: pen tip, 0.01 mm; dL dR: steps; speeds: SPEED_UNIT mm/s
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+namespace cmdbin {
+
+constexpr uint8_t MAGIC[4] = {'V', 'P', 'B', '1'};
+constexpr uint8_t MAGIC_COMPILED[4] = {'V', 'P', 'C', '1'};
+constexpr uint8_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 40;
+constexpr double UNIT = 0.01;            // mm per count
+constexpr double SPEED_UNIT = 0.1;       // mm/s per count
+
+enum Op : uint8_t {
+    OP_PEN_UP = 0,
+    OP_PEN_DOWN = 1,
+    OP_MOVE = 2,
+    OP_ARC_CW = 3,
+    OP_ARC_CCW = 4,
+    OP_BELT = 5,
+};
+
+constexpr size_t MAX_VARINT = 5;
+constexpr size_t MAX_RECORD = 1 + 6 * MAX_VARINT;
+
+struct Header {
+    int32_t totalDistance = 0;
+    int32_t height = 0;
+    int32_t minX = 0, minY = 0, maxX = 0, maxY = 0;
+    uint32_t count = 0;
+};
+
+inline int32_t toUnits(double mm) {
+    return (int32_t)lround(mm / UNIT);
+}
+
+inline double toMM(int32_t units) {
+    return (double)units * UNIT;
+}
+
+inline uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// Writes at most MAX_VARINT bytes, returns the count.
+inline size_t putVarint(uint8_t* out, int32_t value) {
+    uint32_t v = zigzag(value);
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+// False on a truncated or overlong varint; p is advanced past it.
+inline bool getVarint(const uint8_t*& p, const uint8_t* end, int32_t& value) {
+    uint32_t v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p >= end) return false;
+        const uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            value = unzigzag(v);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void putU32(uint8_t* out, uint32_t v) {
+    out[0] = (uint8_t)v;
+    out[1] = (uint8_t)(v >> 8);
+    out[2] = (uint8_t)(v >> 16);
+    out[3] = (uint8_t)(v >> 24);
+}
+
+inline uint32_t getU32(const uint8_t* in) {
+    return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+inline void encodeHeader(const Header& h, uint8_t* out) {
+    for (int i = 0; i < 4; i++) out[i] = MAGIC[i];
+    out[4] = VERSION;
+    out[5] = 0;
+    out[6] = 0;
+    out[7] = 0;
+    putU32(out + 8, (uint32_t)h.totalDistance);
+    putU32(out + 12, (uint32_t)h.height);
+    putU32(out + 16, (uint32_t)h.minX);
+    putU32(out + 20, (uint32_t)h.minY);
+    putU32(out + 24, (uint32_t)h.maxX);
+    putU32(out + 28, (uint32_t)h.maxY);
+    putU32(out + 32, h.count);
+    putU32(out + 36, 0);
+}
+
+inline bool isBinary(const uint8_t* in, size_t len) {
+    return len >= 4 && in[0] == MAGIC[0] && in[1] == MAGIC[1] && in[2] == MAGIC[2] && in[3] == MAGIC[3];
+}
+
+inline bool isCompiled(const uint8_t* in, size_t len) {
+    return len >= 4 && in[0] == MAGIC_COMPILED[0] && in[1] == MAGIC_COMPILED[1] && in[2] == MAGIC_COMPILED[2] &&
+           in[3] == MAGIC_COMPILED[3];
+}
+
+// False if the magic or the version does not match (either magic is accepted:
+// the compiled header starts with the same fields).
+inline bool decodeHeader(const uint8_t* in, size_t len, Header& h) {
+    if (len < HEADER_SIZE || !(isBinary(in, len) || isCompiled(in, len)) || in[4] != VERSION) return false;
+    h.totalDistance = (int32_t)getU32(in + 8);
+    h.height = (int32_t)getU32(in + 12);
+    h.minX = (int32_t)getU32(in + 16);
+    h.minY = (int32_t)getU32(in + 20);
+    h.maxX = (int32_t)getU32(in + 24);
+    h.maxY = (int32_t)getU32(in + 28);
+    h.count = getU32(in + 32);
+    return true;
+}
+
+// Machine parameters a compiled file depends on, in fixed point so that the
+// comparison is exact. Lengths in um, fractions in 1e-4.
+struct Machine {
+    int32_t topDistanceMM = 0;
+    int32_t tcpXUm = 0, tcpYUm = 0;
+    int32_t stepsPerRotation = 0;
+    int32_t travelPerRotationUm = 0;
+    int32_t dtUm = 0, dpUm = 0, dmUm = 0;
+    int32_t wallOffsetUm = 0;
+    int32_t massG = 0;
+    int32_t gravityMmS2 = 0;
+    int32_t safeXFrac = 0, safeYFrac = 0;
+    int32_t elongationPerMN = 0;   // belt_elongation_coefficient, 1e-6 per N
+    int32_t kinFloat = 0;          // IK kernel in float (VPLOTTER_KIN_FLOAT)
+    int32_t reserved = 0;
+};
+
+constexpr size_t MACHINE_FIELDS = 16;
+constexpr size_t MACHINE_SIZE = MACHINE_FIELDS * 4;
+constexpr size_t COMPILED_HEADER_SIZE = HEADER_SIZE + MACHINE_SIZE + 16;
+
+inline int32_t toFixed(double v, double scale) {
+    return (int32_t)lround(v * scale);
+}
+
+// Same scaling on the device (Movement::machine()) and in the compiler.
+inline Machine makeMachine(double topDistance, double tcpX, double tcpY, int32_t stepsPerRotation,
+                           double travelPerRotation, double dT, double dP, double dM, double wallOffset, double massKg,
+                           double gravity, double safeX, double safeY, double elongation, bool kinFloat) {
+    Machine m;
+    m.topDistanceMM = toFixed(topDistance, 1.0);
+    m.tcpXUm = toFixed(tcpX, 1000.0);
+    m.tcpYUm = toFixed(tcpY, 1000.0);
+    m.stepsPerRotation = stepsPerRotation;
+    m.travelPerRotationUm = toFixed(travelPerRotation, 1000.0);
+    m.dtUm = toFixed(dT, 1000.0);
+    m.dpUm = toFixed(dP, 1000.0);
+    m.dmUm = toFixed(dM, 1000.0);
+    m.wallOffsetUm = toFixed(wallOffset, 1000.0);
+    m.massG = toFixed(massKg, 1000.0);
+    m.gravityMmS2 = toFixed(gravity, 1000.0);
+    m.safeXFrac = toFixed(safeX, 10000.0);
+    m.safeYFrac = toFixed(safeY, 10000.0);
+    m.elongationPerMN = toFixed(elongation, 1000000.0);
+    m.kinFloat = kinFloat ? 1 : 0;
+    return m;
+}
+
+inline void machineFields(const Machine& m, int32_t* f) {
+    f[0] = m.topDistanceMM;
+    f[1] = m.tcpXUm;
+    f[2] = m.tcpYUm;
+    f[3] = m.stepsPerRotation;
+    f[4] = m.travelPerRotationUm;
+    f[5] = m.dtUm;
+    f[6] = m.dpUm;
+    f[7] = m.dmUm;
+    f[8] = m.wallOffsetUm;
+    f[9] = m.massG;
+    f[10] = m.gravityMmS2;
+    f[11] = m.safeXFrac;
+    f[12] = m.safeYFrac;
+    f[13] = m.elongationPerMN;
+    f[14] = m.kinFloat;
+    f[15] = m.reserved;
+}
+
+inline const char* machineFieldName(size_t i) {
+    static const char* const NAMES[MACHINE_FIELDS] = {
+        "topDistance", "tcpOffsetX", "tcpOffsetY", "stepsPerRotation", "travelPerRotation", "d_t", "d_p", "d_m",
+        "midPulleyToWall", "mass_bot", "g_constant", "safeXFraction", "safeYFraction", "belt_elongation", "kinFloat",
+        "reserved"};
+    return i < MACHINE_FIELDS ? NAMES[i] : "?";
+}
+
+// Name of the first parameter that differs, nullptr if they match.
+inline const char* machineMismatch(const Machine& a, const Machine& b) {
+    int32_t fa[MACHINE_FIELDS], fb[MACHINE_FIELDS];
+    machineFields(a, fa);
+    machineFields(b, fb);
+    for (size_t i = 0; i < MACHINE_FIELDS; i++) {
+        if (fa[i] != fb[i]) return machineFieldName(i);
+    }
+    return nullptr;
+}
+
+struct CompiledHeader {
+    Header base;
+    Machine machine;
+    int32_t startX = 0, startY = 0;
+    int32_t startL = 0, startR = 0;
+};
+
+inline void encodeCompiledHeader(const CompiledHeader& h, uint8_t* out) {
+    encodeHeader(h.base, out);
+    for (int i = 0; i < 4; i++) out[i] = MAGIC_COMPILED[i];
+    int32_t f[MACHINE_FIELDS];
+    machineFields(h.machine, f);
+    uint8_t* p = out + HEADER_SIZE;
+    for (size_t i = 0; i < MACHINE_FIELDS; i++, p += 4) putU32(p, (uint32_t)f[i]);
+    putU32(p, (uint32_t)h.startX);
+    putU32(p + 4, (uint32_t)h.startY);
+    putU32(p + 8, (uint32_t)h.startL);
+    putU32(p + 12, (uint32_t)h.startR);
+}
+
+inline bool decodeCompiledHeader(const uint8_t* in, size_t len, CompiledHeader& h) {
+    if (len < COMPILED_HEADER_SIZE || !isCompiled(in, len) || !decodeHeader(in, len, h.base)) return false;
+    const uint8_t* p = in + HEADER_SIZE;
+    int32_t f[MACHINE_FIELDS];
+    for (size_t i = 0; i < MACHINE_FIELDS; i++, p += 4) f[i] = (int32_t)getU32(p);
+    Machine& m = h.machine;
+    m.topDistanceMM = f[0];
+    m.tcpXUm = f[1];
+    m.tcpYUm = f[2];
+    m.stepsPerRotation = f[3];
+    m.travelPerRotationUm = f[4];
+    m.dtUm = f[5];
+    m.dpUm = f[6];
+    m.dmUm = f[7];
+    m.wallOffsetUm = f[8];
+    m.massG = f[9];
+    m.gravityMmS2 = f[10];
+    m.safeXFrac = f[11];
+    m.safeYFrac = f[12];
+    m.elongationPerMN = f[13];
+    m.kinFloat = f[14];
+    m.reserved = f[15];
+    h.startX = (int32_t)getU32(p);
+    h.startY = (int32_t)getU32(p + 4);
+    h.startL = (int32_t)getU32(p + 8);
+    h.startR = (int32_t)getU32(p + 12);
+    return true;
+}
+
+}  // namespace cmdbin
+
+#endif
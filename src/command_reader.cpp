@@ -0,0 +1,394 @@
+#include "command_reader.h"
+#include "command_format.h"
+
+#include <string.h>
+#include <math.h>
+
+static inline bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+void CommandReader::begin(SdPrefetch* src) {
+    source = src;
+    pos = 0;
+    len = 0;
+    lastStart = 0;
+    bufStart = 0;
+    fileEnd = (source == nullptr);
+    dropping = false;
+    binary = false;
+    compiled = false;
+    compiledHead = cmdbin::CompiledHeader();
+    curX = curY = lastX = lastY = 0;
+    curL = curR = lastL = lastR = 0;
+}
+
+bool CommandReader::available() const {
+    return pos < len || !fileEnd;
+}
+
+// Move the unread tail to the front and append one block behind it.
+bool CommandReader::refill_() {
+    if (fileEnd) return false;
+
+    size_t tail = len - pos;
+    if (tail > MAX_LINE) {
+        // no newline in sight: not a command line, skip to the next one
+        tail = 0;
+        dropping = true;
+    }
+    if (tail > 0 && pos > 0) memmove(buf, buf + pos, tail);
+    bufStart += (uint32_t)(len - tail);
+    pos = 0;
+    len = tail;
+
+    const size_t got = source->read((uint8_t*)buf + len);
+    if (got == 0) {
+        fileEnd = true;
+        return false;
+    }
+    len += got;
+    return true;
+}
+
+// At least `bytes` unread bytes in the buffer (fewer only at the end of the file).
+bool CommandReader::ensure_(size_t bytes) {
+    while (len - pos < bytes) {
+        if (!refill_()) break;
+    }
+    return len - pos >= bytes;
+}
+
+bool CommandReader::readHeader(double& totalDistance, double& height) {
+    ensure_(cmdbin::COMPILED_HEADER_SIZE);
+    compiled = cmdbin::isCompiled((const uint8_t*)buf + pos, len - pos);
+    if (compiled) {
+        if (!cmdbin::decodeCompiledHeader((const uint8_t*)buf + pos, len - pos, compiledHead)) return false;
+        binary = true;
+        pos += cmdbin::COMPILED_HEADER_SIZE;
+        curX = compiledHead.startX;
+        curY = compiledHead.startY;
+        curL = compiledHead.startL;
+        curR = compiledHead.startR;
+        totalDistance = cmdbin::toMM(compiledHead.base.totalDistance);
+        height = cmdbin::toMM(compiledHead.base.height);
+        return true;
+    }
+
+    binary = cmdbin::isBinary((const uint8_t*)buf + pos, len - pos);
+    if (binary) {
+        cmdbin::Header h;
+        if (!cmdbin::decodeHeader((const uint8_t*)buf + pos, len - pos, h)) return false;
+        pos += cmdbin::HEADER_SIZE;
+        totalDistance = cmdbin::toMM(h.totalDistance);
+        height = cmdbin::toMM(h.height);
+        return true;
+    }
+
+    const char* b;
+    const char* e;
+    if (!nextLine_(b, e) || e - b < 2 || b[0] != 'd') return false;
+    b++;
+    totalDistance = 0.0;
+    parseNumber(b, e, totalDistance);
+
+    if (!nextLine_(b, e) || e - b < 2 || b[0] != 'h') return false;
+    b++;
+    height = 0.0;
+    parseNumber(b, e, height);
+    return true;
+}
+
+bool CommandReader::nextLine_(const char*& begin, const char*& end) {
+    for (;;) {
+        const char* nl = (const char*)memchr(buf + pos, '\n', len - pos);
+        if (!nl) {
+            if (refill_()) continue;
+            if (pos >= len) return false;
+            nl = buf + len;   // last line without a newline
+        }
+
+        const size_t start = pos;
+        const char* b = buf + pos;
+        const char* e = nl;
+        pos = (size_t)(nl - buf);
+        if (pos < len) pos++;
+
+        // overlong lines are dropped whether or not they straddle a refill,
+        // so the line count does not depend on the block boundaries
+        if (dropping || e - b > (ptrdiff_t)MAX_LINE) {
+            dropping = false;
+            continue;
+        }
+
+        while (b < e && isBlank(*b)) b++;
+        while (e > b && isBlank(e[-1])) e--;
+        if (b == e) continue;
+
+        lastStart = start;
+        begin = b;
+        end = e;
+        return true;
+    }
+}
+
+bool CommandReader::nextRecord_(Command& out) {
+    if (!ensure_(cmdbin::MAX_RECORD) && pos >= len) return false;
+
+    const uint8_t* p = (const uint8_t*)buf + pos;
+    const uint8_t* end = (const uint8_t*)buf + len;
+    const uint8_t op = *p++;
+
+    out = Command();
+    int32_t v[6] = {0, 0, 0, 0, 0, 0};
+    int operands = 0;
+    switch (op) {
+        case cmdbin::OP_PEN_UP:
+        case cmdbin::OP_PEN_DOWN:
+            out.kind = Command::Pen;
+            out.down = (op == cmdbin::OP_PEN_DOWN);
+            break;
+        case cmdbin::OP_MOVE:
+            out.kind = Command::Move;
+            operands = 2;
+            break;
+        case cmdbin::OP_ARC_CW:
+        case cmdbin::OP_ARC_CCW:
+            out.kind = Command::Arc;
+            out.cw = (op == cmdbin::OP_ARC_CW);
+            operands = 4;
+            break;
+        case cmdbin::OP_BELT:
+            if (!compiled) {
+                pos = len;
+                fileEnd = true;
+                return false;
+            }
+            out.kind = Command::Belt;
+            operands = 6;
+            break;
+        default:
+            // unknown opcode: the operand length is unknown too, stop here
+            pos = len;
+            fileEnd = true;
+            return false;
+    }
+    for (int k = 0; k < operands; k++) {
+        if (!cmdbin::getVarint(p, end, v[k])) {
+            pos = len;   // truncated file
+            return false;
+        }
+    }
+
+    lastStart = pos;
+    pos = (size_t)((const char*)p - buf);
+    lastX = curX;
+    lastY = curY;
+    lastL = curL;
+    lastR = curR;
+    if (operands > 0) {
+        if (out.kind == Command::Arc) {
+            out.i = cmdbin::toMM(v[2]);
+            out.j = cmdbin::toMM(v[3]);
+        } else if (out.kind == Command::Belt) {
+            curL += v[2];
+            curR += v[3];
+            out.beltL = curL;
+            out.beltR = curR;
+            out.vNom = v[4] * cmdbin::SPEED_UNIT;
+            out.vJunction = v[5] * cmdbin::SPEED_UNIT;
+        }
+        curX += v[0];
+        curY += v[1];
+        out.x = cmdbin::toMM(curX);
+        out.y = cmdbin::toMM(curY);
+    }
+    return true;
+}
+
+bool CommandReader::next(Command& out) {
+    if (binary) return nextRecord_(out);
+
+    const char* b;
+    const char* e;
+    if (!nextLine_(b, e)) return false;
+    parseLine(b, e, out);
+    return true;
+}
+
+void CommandReader::resumeAt(uint32_t fileOffset, double x, double y, long beltL, long beltR) {
+    pos = 0;
+    len = 0;
+    lastStart = 0;
+    bufStart = fileOffset;
+    fileEnd = (source == nullptr);
+    dropping = false;
+    curX = lastX = cmdbin::toUnits(x);
+    curY = lastY = cmdbin::toUnits(y);
+    curL = lastL = (int32_t)beltL;
+    curR = lastR = (int32_t)beltR;
+}
+
+void CommandReader::unread() {
+    pos = lastStart;
+    if (binary) {
+        curX = lastX;
+        curY = lastY;
+        curL = lastL;
+        curR = lastR;
+    }
+}
+
+bool CommandReader::parseNumber(const char*& p, const char* end, double& out) {
+    // exact powers of ten: one rounding step for up to 15 significant digits
+    static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+    const char* s = p;
+    bool neg = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        neg = (*s == '-');
+        s++;
+    }
+
+    uint64_t mant = 0;
+    int digits = 0;   // significant digits in mant
+    int scale = 0;    // power of ten applied to mant
+    bool any = false;
+    for (; s < end && isDigit(*s); s++) {
+        any = true;
+        if (digits < 18) {
+            mant = mant * 10 + (uint64_t)(*s - '0');
+            if (mant != 0) digits++;
+        } else {
+            scale++;
+        }
+    }
+    if (s < end && *s == '.') {
+        s++;
+        for (; s < end && isDigit(*s); s++) {
+            any = true;
+            if (digits < 18) {
+                mant = mant * 10 + (uint64_t)(*s - '0');
+                if (mant != 0) digits++;
+                scale--;
+            }
+        }
+    }
+    if (!any) return false;
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char* x = s + 1;
+        bool expNeg = false;
+        if (x < end && (*x == '-' || *x == '+')) {
+            expNeg = (*x == '-');
+            x++;
+        }
+        if (x < end && isDigit(*x)) {
+            int ex = 0;
+            for (; x < end && isDigit(*x); x++) {
+                if (ex < 1000) ex = ex * 10 + (*x - '0');
+            }
+            scale += expNeg ? -ex : ex;
+            s = x;
+        }
+    }
+
+    double v = (double)mant;
+    if (mant != 0 && scale != 0) {
+        const int a = scale < 0 ? -scale : scale;
+        const double f = (a <= 22) ? POW10[a] : pow(10.0, (double)a);
+        v = (scale < 0) ? v / f : v * f;
+    }
+    out = neg ? -v : v;
+    p = s;
+    return true;
+}
+
+static bool parsePoint(const char* begin, const char* end, double& x, double& y) {
+    const char* p = begin;
+    if (!CommandReader::parseNumber(p, end, x)) return false;
+    if (p >= end || !isBlank(*p)) return false;
+    while (p < end && isBlank(*p)) p++;
+    return CommandReader::parseNumber(p, end, y);
+}
+
+static bool parseArc(const char* begin, const char* end, bool& cw, double& x, double& y, double& i, double& j) {
+    const char* p = begin;
+    if (end - p < 2 || (p[0] != 'g' && p[0] != 'G') || (p[1] != '2' && p[1] != '3')) return false;
+    cw = (p[1] == '2');
+    while (p < end && !isBlank(*p)) p++;
+
+    // labelled words win; otherwise the first four numbers are x y i j
+    double labelled[4] = {0.0, 0.0, 0.0, 0.0};
+    double positional[4] = {0.0, 0.0, 0.0, 0.0};
+    bool has[4] = {false, false, false, false};
+    bool anyLabel = false;
+    int count = 0;
+
+    for (;;) {
+        while (p < end && isBlank(*p)) p++;
+        if (p >= end) break;
+        const char* t = p;
+        while (p < end && !isBlank(*p)) p++;
+
+        int slot = -1;
+        switch (*t) {
+            case 'x': case 'X': slot = 0; break;
+            case 'y': case 'Y': slot = 1; break;
+            case 'i': case 'I': slot = 2; break;
+            case 'j': case 'J': slot = 3; break;
+            default: break;
+        }
+
+        const char* q = t;
+        double v = 0.0;
+        if (slot >= 0 && p - t >= 2) {
+            q++;
+            CommandReader::parseNumber(q, p, v);
+            labelled[slot] = v;
+            has[slot] = true;
+            anyLabel = true;
+        } else if (count < 4) {
+            CommandReader::parseNumber(q, p, v);
+            positional[count] = v;
+        }
+        count++;
+    }
+
+    if (anyLabel) {
+        if (!(has[0] && has[1] && has[2] && has[3])) return false;
+        x = labelled[0];
+        y = labelled[1];
+        i = labelled[2];
+        j = labelled[3];
+        return true;
+    }
+
+    if (count < 4) return false;
+    x = positional[0];
+    y = positional[1];
+    i = positional[2];
+    j = positional[3];
+    return true;
+}
+
+void CommandReader::parseLine(const char* begin, const char* end, Command& out) {
+    out = Command();
+    if (begin >= end) return;
+
+    if (begin[0] == 'p') {
+        out.kind = Command::Pen;
+        out.down = (end - begin > 1 && begin[1] == '1');
+        return;
+    }
+    if (parseArc(begin, end, out.cw, out.x, out.y, out.i, out.j)) {
+        out.kind = Command::Arc;
+        return;
+    }
+    if (parsePoint(begin, end, out.x, out.y)) out.kind = Command::Move;
+}
@@ -0,0 +1,98 @@
+#ifndef COMMAND_READER_H
+#define COMMAND_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sd/sd_prefetch.h"
+#include "command_format.h"
+
+// Reader for the /commands file, text or binary (see command_format.h).
+//
+// Blocks of whole SD sectors come from the prefetch task into a buffer that is
+// part of the object. Text lines are parsed and binary records decoded in
+// place; either way the Runner gets one Command per line/record and nothing
+// is allocated.
+class CommandReader {
+public:
+    static constexpr size_t BLOCK = SdPrefetch::BLOCK;
+    static constexpr size_t MAX_LINE = 128;   // longer lines are dropped
+
+    struct Command {
+        enum Kind : uint8_t { Other, Pen, Move, Arc, Belt } kind = Other;
+        bool down = false;   // Pen
+        bool cw = false;     // Arc
+        double x = 0.0;      // Move/Arc/Belt end, mm
+        double y = 0.0;
+        double i = 0.0;      // Arc center minus the start point, mm
+        double j = 0.0;
+        long beltL = 0;      // Belt: absolute step targets
+        long beltR = 0;
+        double vNom = 0.0;       // Belt: planned speeds, mm/s
+        double vJunction = 0.0;
+    };
+
+    // Read the blocks of a started prefetch.
+    void begin(SdPrefetch* source);
+
+    // Detect the format and read the header; false if it is not a job file.
+    bool readHeader(double& totalDistance, double& height);
+    bool isBinary() const { return binary; }
+
+    // Compiled (belt space) file; its header is valid after readHeader().
+    bool isCompiled() const { return compiled; }
+    const cmdbin::CompiledHeader& compiledHeader() const { return compiledHead; }
+
+    // More commands may follow (buffered or still in the file).
+    bool available() const;
+
+    // Next command (empty text lines are skipped, unknown ones are Other);
+    // false at the end of the file.
+    bool next(Command& out);
+
+    // Hand out the last command again on the next call (one of pushback).
+    void unread();
+
+    // File offset of the next command (for the restart index).
+    uint32_t offset() const { return bufStart + (uint32_t)pos; }
+
+    // Continue at a command start taken from offset(), after the header was
+    // read and the source restarted there. x/y and the belt steps are the
+    // point before it (binary and compiled records are deltas).
+    void resumeAt(uint32_t fileOffset, double x, double y, long beltL, long beltR);
+
+    // Decimal number with optional sign, fraction and exponent, as written by
+    // the converters. Advances p past it; false if no digits are found.
+    static bool parseNumber(const char*& p, const char* end, double& out);
+
+    // One trimmed text line: "x y", "p0"/"p1", "G2/G3 X.. Y.. I.. J.." (any
+    // order, any case) or "G2/G3 x y i j".
+    static void parseLine(const char* begin, const char* end, Command& out);
+
+private:
+    bool refill_();
+    bool ensure_(size_t bytes);
+    bool nextLine_(const char*& begin, const char*& end);
+    bool nextRecord_(Command& out);
+
+    SdPrefetch* source = nullptr;
+    char buf[MAX_LINE + BLOCK];
+    size_t pos = 0;          // start of the unread data
+    size_t len = 0;          // end of the valid data
+    size_t lastStart = 0;    // where the last command handed out starts
+    uint32_t bufStart = 0;   // file offset of buf[0]
+    bool fileEnd = true;
+    bool dropping = false;   // inside a line longer than MAX_LINE
+
+    // binary: current point in format units, and before the last record
+    bool binary = false;
+    int32_t curX = 0, curY = 0;
+    int32_t lastX = 0, lastY = 0;
+
+    // compiled: belt position in steps, and before the last record
+    bool compiled = false;
+    cmdbin::CompiledHeader compiledHead;
+    int32_t curL = 0, curR = 0;
+    int32_t lastL = 0, lastR = 0;
+};
+
+#endif
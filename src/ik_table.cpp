@@ -0,0 +1,70 @@
+#include "ik_table.h"
+
+#include <math.h>
+#include <new>
+
+constexpr double IkTable::SCALE[IkTable::CHANNELS];
+
+IkTable::~IkTable() {
+    clear();
+}
+
+bool IkTable::allocate(double x0, double y0, double x1, double y1) {
+    clear();
+    if (!(x1 > x0) || !(y1 > y0)) return false;
+
+    data = new (std::nothrow) int16_t[(size_t)NODES * NODES * CHANNELS];
+    if (!data) return false;
+
+    this->x0 = x0;
+    this->y0 = y0;
+    stepX = (x1 - x0) / (NODES - 1);
+    stepY = (y1 - y0) / (NODES - 1);
+    invStepX = 1.0 / stepX;
+    invStepY = 1.0 / stepY;
+    return true;
+}
+
+void IkTable::clear() {
+    delete[] data;
+    data = nullptr;
+}
+
+bool IkTable::set(int ix, int iy, const double values[CHANNELS]) {
+    if (!data || ix < 0 || iy < 0 || ix >= NODES || iy >= NODES) return false;
+
+    int16_t* node = data + ((size_t)iy * NODES + ix) * CHANNELS;
+    for (int c = 0; c < CHANNELS; c++) {
+        const double q = round(values[c] * SCALE[c]);
+        if (!(q >= -32767.0 && q <= 32767.0)) return false;
+        node[c] = (int16_t)q;
+    }
+    return true;
+}
+
+bool IkTable::lookup(double x, double y, double out[CHANNELS]) const {
+    if (!data) return false;
+
+    const double fx = (x - x0) * invStepX;
+    const double fy = (y - y0) * invStepY;
+    if (!(fx >= 0.0 && fy >= 0.0 && fx <= NODES - 1 && fy <= NODES - 1)) return false;
+
+    int ix = (int)fx;
+    int iy = (int)fy;
+    if (ix > NODES - 2) ix = NODES - 2;
+    if (iy > NODES - 2) iy = NODES - 2;
+    const double u = fx - ix;
+    const double v = fy - iy;
+
+    const int16_t* n00 = data + ((size_t)iy * NODES + ix) * CHANNELS;
+    const int16_t* n10 = n00 + CHANNELS;
+    const int16_t* n01 = n00 + NODES * CHANNELS;
+    const int16_t* n11 = n01 + CHANNELS;
+
+    for (int c = 0; c < CHANNELS; c++) {
+        const double a = n00[c] + (n10[c] - n00[c]) * u;
+        const double b = n01[c] + (n11[c] - n01[c]) * u;
+        out[c] = (a + (b - a) * v) / SCALE[c];
+    }
+    return true;
+}
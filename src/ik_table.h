@@ -0,0 +1,47 @@
+#ifndef IK_TABLE_H
+#define IK_TABLE_H
+
+#include <Arduino.h>
+
+// Regular XY grid of small per-node values, bilinear interpolated.
+//
+// Movement stores the difference between the exact belt lengths (torque
+// equilibrium solve) and the closed-form tilt-free lengths, plus the carriage
+// tilt. Those residuals are small and smooth, so 16 bit fixed point is enough.
+class IkTable {
+public:
+    static constexpr int CHANNELS = 3;
+    static constexpr int NODES = 49;  // per axis
+
+    IkTable() = default;
+    ~IkTable();
+
+    bool allocate(double x0, double y0, double x1, double y1);
+    void clear();
+
+    bool isAllocated() const { return data != nullptr; }
+    size_t bytes() const { return data ? (size_t)NODES * NODES * CHANNELS * sizeof(int16_t) : 0; }
+
+    double nodeX(int ix) const { return x0 + ix * stepX; }
+    double nodeY(int iy) const { return y0 + iy * stepY; }
+
+    // Returns false if a value does not fit the fixed-point range.
+    bool set(int ix, int iy, const double values[CHANNELS]);
+
+    // Returns false outside the grid.
+    bool lookup(double x, double y, double out[CHANNELS]) const;
+
+private:
+    // channel scales: residual left/right in 2 um (+-65 mm), tilt in 50 urad (+-94 deg)
+    static constexpr double SCALE[CHANNELS] = { 500.0, 500.0, 20000.0 };
+
+    int16_t* data = nullptr;
+    double x0 = 0.0;
+    double y0 = 0.0;
+    double stepX = 1.0;
+    double stepY = 1.0;
+    double invStepX = 1.0;
+    double invStepY = 1.0;
+};
+
+#endif
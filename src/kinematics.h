@@ -0,0 +1,197 @@
+#ifndef KINEMATICS_H
+#define KINEMATICS_H
+
+// Kinematics kernel of the V-plotter, templated on the scalar type.
+//
+// No Arduino dependencies, so the same code runs on the ESP32 (float uses the
+// FPU, double is emulated in software) and in host tools. Movement selects the
+// scalar with KinScalar (see movement.h).
+#include <cmath>
+#include <limits>
+
+namespace kin {
+
+constexpr double PI_D = 3.14159265358979323846;
+
+template <typename T>
+struct Geometry {
+    T topDistance;   // pulley to pulley, mm
+    T originX;       // carriage (0,0) in frame coordinates, mm
+    T originY;
+    T d_t;           // distance between the belt tangent points
+    T d_p;           // tangent points above the carriage reference
+    T d_m;           // center of mass below the carriage reference
+    T weight;        // N
+    T wallOffset;    // mid pulley to wall, mm
+};
+
+template <typename T>
+inline T length(T dx, T dy) {
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+// In-plane belt vectors from the pulleys to the carriage tangent points
+// (left pulley at the origin, right pulley at topDistance), for sin/cos of gamma.
+template <typename T>
+inline void beltVectors(const Geometry<T>& g, T frameX, T frameY, T sg, T cg, T& lx, T& ly, T& rx, T& ry) {
+    const T s = g.d_t / T(2);
+    lx = frameX - (s * cg - g.d_p * sg);
+    ly = frameY - (s * sg + g.d_p * cg);
+    rx = g.topDistance - (frameX + (s * cg + g.d_p * sg));
+    ry = frameY + (s * sg - g.d_p * cg);
+}
+
+// Belt lengths for a carriage position in frame coordinates and tilt gamma.
+template <typename T>
+inline void beltLegs(const Geometry<T>& g, T frameX, T frameY, T gamma, T& leftLeg, T& rightLeg) {
+    T lx, ly, rx, ry;
+    beltVectors(g, frameX, frameY, std::sin(gamma), std::cos(gamma), lx, ly, rx, ry);
+
+    const T w2 = g.wallOffset * g.wallOffset;
+    leftLeg = std::sqrt(lx * lx + ly * ly + w2);
+    rightLeg = std::sqrt(rx * rx + ry * ry + w2);
+}
+
+// Same with the carriage level (gamma = 0), no trig.
+template <typename T>
+inline void flatBeltLegs(const Geometry<T>& g, T frameX, T frameY, T& leftLeg, T& rightLeg) {
+    const T lx = frameX - g.d_t / T(2);
+    const T rx = g.topDistance - (frameX + g.d_t / T(2));
+    const T y = frameY - g.d_p;
+
+    const T w2 = g.wallOffset * g.wallOffset;
+    leftLeg = std::sqrt(lx * lx + y * y + w2);
+    rightLeg = std::sqrt(rx * rx + y * y + w2);
+}
+
+// Newton iteration on the torque balance T_R - T_L + T_m = 0.
+// Belt angles and forces are re-evaluated at every step; the derivative treats
+// them as constant, which is accurate because the tangent points move by
+// millimeters while the belts are hundreds of millimeters long. Trig is done
+// on the belt direction vectors, so one step costs one sin/cos pair and two
+// square roots. gamma is the warm start and is only written on success.
+template <typename T>
+inline bool solveTiltNewton(const Geometry<T>& g, T frameX, T frameY, T tolerance, T& gamma, T& F_L, T& F_R) {
+    constexpr int max_iterations = 12;
+    const T max_step = T(10.0 * PI_D / 180.0);
+    const T half_pi = T(PI_D / 2.0);
+
+    // below this the step size is rounding noise
+    const T min_tolerance = std::numeric_limits<T>::epsilon() * T(64);
+    if (tolerance < min_tolerance) tolerance = min_tolerance;
+
+    const T s = g.d_t / T(2);
+    T gm = gamma;
+    for (int i = 0; i < max_iterations; i++) {
+        const T sg = std::sin(gm);
+        const T cg = std::cos(gm);
+
+        T lx, ly, rx, ry;
+        beltVectors(g, frameX, frameY, sg, cg, lx, ly, rx, ry);
+
+        const T hl = std::sqrt(lx * lx + ly * ly);
+        const T hr = std::sqrt(rx * rx + ry * ry);
+        if (!(hl > T(1e-6)) || !(hr > T(1e-6))) return false;
+
+        const T sinL = ly / hl, cosL = lx / hl;
+        const T sinR = ry / hr, cosR = rx / hr;
+
+        const T sinLR = sinL * cosR + cosL * sinR;  // sin(phi_L + phi_R)
+        if (!(std::fabs(sinLR) > T(1e-6))) return false;
+        F_R = g.weight * cosL / sinLR;
+        F_L = g.weight * cosR / sinLR;
+
+        const T sinAlpha = sinL * cg - cosL * sg;  // sin(phi_L - gamma)
+        const T cosAlpha = cosL * cg + sinL * sg;
+        const T sinBeta = sinR * cg + cosR * sg;   // sin(phi_R + gamma)
+        const T cosBeta = cosR * cg - sinR * sg;
+
+        // T_m = d_m * tan(gamma) * F_G * cos(gamma) = d_m * F_G * sin(gamma)
+        const T torque = s * sinBeta * F_R - s * sinAlpha * F_L + g.d_m * g.weight * sg;
+        const T dTorque = s * cosBeta * F_R + s * cosAlpha * F_L + g.d_m * g.weight * cg;
+        if (!(std::fabs(dTorque) > T(1e-9))) return false;
+
+        T step = torque / dTorque;
+        if (step > max_step) step = max_step;
+        if (step < -max_step) step = -max_step;
+        gm -= step;
+
+        if (!std::isfinite(gm) || std::fabs(gm) >= half_pi) return false;
+        if (std::fabs(step) < tolerance) {
+            gamma = gm;
+            return true;
+        }
+    }
+    return false;
+}
+
+// GRBL junction deviation limit: v = sqrt(a * jd * s / (1 - s)), with s the
+// sine of half the inner angle between the two moves. The callers have the
+// turn (0 = straight on, pi = reversal); sin(inner / 2) = cos(turn / 2).
+// Straight on returns `unlimited`, a reversal 0. Units follow accel and jd.
+template <typename T>
+inline T junctionSpeed(T cosTurn, T accel, T junctionDeviation, T unlimited = T(1e9)) {
+    if (cosTurn > T(1)) cosTurn = T(1);
+    if (cosTurn < T(-1)) cosTurn = T(-1);
+    const T sinHalfInner = std::sqrt(T(0.5) * (T(1) + cosTurn));
+    if (sinHalfInner > T(1) - T(1e-9)) return unlimited;
+    const T v2 = accel * junctionDeviation * sinHalfInner / (T(1) - sinHalfInner);
+    if (!(v2 > T(0))) return T(0);
+    const T v = std::sqrt(v2);
+    return v < unlimited ? v : unlimited;
+}
+
+// Forward kinematics: carriage position (frame coordinates) and tilt for two
+// belt lengths. Gauss-Newton on (x, y); the tilt is re-solved at every step
+// and held fixed in the Jacobian. frameX/frameY/gamma are the warm start and
+// are only written on success. tolerance is in mm.
+template <typename T>
+inline bool forwardKinematics(const Geometry<T>& g, T leftLeg, T rightLeg, T tolerance, T tiltTolerance,
+                              T& frameX, T& frameY, T& gamma) {
+    constexpr int max_iterations = 10;
+    const T max_step = T(50);
+
+    T x = frameX, y = frameY, gm = gamma;
+    const T w2 = g.wallOffset * g.wallOffset;
+
+    for (int i = 0; i < max_iterations; i++) {
+        T F_L, F_R;
+        if (!solveTiltNewton(g, x, y, tiltTolerance, gm, F_L, F_R)) return false;
+
+        T lx, ly, rx, ry;
+        beltVectors(g, x, y, std::sin(gm), std::cos(gm), lx, ly, rx, ry);
+        const T L = std::sqrt(lx * lx + ly * ly + w2);
+        const T R = std::sqrt(rx * rx + ry * ry + w2);
+
+        // d(L, R)/d(x, y); rx shrinks when x grows
+        const T a = lx / L, b = ly / L;
+        const T c = -rx / R, d = ry / R;
+        const T det = a * d - b * c;
+        if (!(std::fabs(det) > T(1e-9))) return false;
+
+        const T eL = leftLeg - L;
+        const T eR = rightLeg - R;
+        T dx = (d * eL - b * eR) / det;
+        T dy = (a * eR - c * eL) / det;
+        const T n = std::fabs(dx) + std::fabs(dy);
+        if (n > max_step) {
+            dx *= max_step / n;
+            dy *= max_step / n;
+        }
+        x += dx;
+        y += dy;
+
+        if (!std::isfinite(x) || !std::isfinite(y)) return false;
+        if (std::fabs(dx) + std::fabs(dy) < tolerance) {
+            frameX = x;
+            frameY = y;
+            gamma = gm;
+            return true;
+        }
+    }
+    return false;
+}
+
+}  // namespace kin
+
+#endif
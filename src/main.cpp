@@ -30,6 +30,7 @@
 #include "phases/phasemanager.h"
 #include "service/weblog.h"
 #include "service/commands_optimizer.h"
+#include "service/commands_converter.h"
 #include "svgmeta.h"
 
 #include <Arduino.h>
@@ -72,14 +73,35 @@ constexpr const char* PREF_KEY_PENMERGE = "penMerge";
 // Planner / quality tuning preference keys
 constexpr const char* PREF_KEY_JUNC_DEV   = "jdev";
 constexpr const char* PREF_KEY_LOOKAHEAD  = "lookahd";
+constexpr const char* PREF_KEY_LOOKAHEAD_S = "lookahds";
 constexpr const char* PREF_KEY_MINSEGMS   = "minsegms";
 constexpr const char* PREF_KEY_CORNERSLOW = "cornslow";
 constexpr const char* PREF_KEY_MINCORNER  = "mincorn";
 constexpr const char* PREF_KEY_MINSEGLEN  = "minsegln";
 constexpr const char* PREF_KEY_COLLINEAR  = "colinr";
+constexpr const char* PREF_KEY_SIMPLIFY   = "simplifytol";
 constexpr const char* PREF_KEY_BACKLASHX  = "backlx";
 constexpr const char* PREF_KEY_BACKLASHY  = "backly";
 constexpr const char* PREF_KEY_SCURVE     = "scurve";
+constexpr const char* PREF_KEY_MAX_JERK   = "maxjerk";
+constexpr const char* PREF_KEY_SHAPER     = "shaper";
+constexpr const char* PREF_KEY_SHAPER_HZ  = "shaperhz";
+constexpr const char* PREF_KEY_SHAPER_AUTO = "shaperauto";
+constexpr const char* PREF_KEY_TOPP       = "topp";
+constexpr const char* PREF_KEY_DYN_ACCEL  = "dynaccel";
+constexpr const char* PREF_KEY_CURVATURE  = "curvspeed";
+constexpr const char* PREF_KEY_BLEND      = "blendmm";
+constexpr const char* PREF_KEY_GRAV_GAIN  = "gravgain";
+constexpr const char* PREF_KEY_BELT_MINF  = "beltminf";
+constexpr const char* PREF_KEY_BELT_MAXF  = "beltmaxf";
+constexpr const char* PREF_KEY_STREAM     = "stream";
+constexpr const char* PREF_KEY_IKTABLE    = "iktable";
+constexpr const char* PREF_KEY_IKNEWTON   = "iknewton";
+constexpr const char* PREF_KEY_IKTOL      = "iktol";
+constexpr const char* PREF_KEY_BELTTRAVEL = "belttravel";
+constexpr const char* PREF_KEY_MAXDEV     = "maxdev";
+constexpr const char* PREF_KEY_FEEDMODE   = "feedmode";
+constexpr const char* PREF_KEY_MAXSTEPR   = "maxsteprate";
 
 constexpr const char* PREF_KEY_MICRO_LEN  = "microlen";
 constexpr const char* PREF_KEY_MICRO_MINF = "microminf";
@@ -210,6 +232,51 @@ struct SdGuard {
   }
 };
 
+// --- Whole-file scans of /commands (restart index, binary conversion) ---
+// The POST handler only queues one, loop() runs it, GET on the same path polls.
+enum class SdJobState : uint8_t { Idle, Queued, Running, Done, Failed };
+static volatile SdJobState gIndexJob = SdJobState::Idle;
+static CommandsIndexStats gIndexStats;
+static volatile SdJobState gConvertJob = SdJobState::Idle;
+static CommandsConvertStats gConvertStats;
+
+static const char* sdJobStateName(SdJobState s)
+{
+  switch (s) {
+    case SdJobState::Queued:  return "queued";
+    case SdJobState::Running: return "running";
+    case SdJobState::Done:    return "done";
+    case SdJobState::Failed:  return "failed";
+    default:                  return "idle";
+  }
+}
+
+static bool sdJobBusy(SdJobState s)
+{
+  return s == SdJobState::Queued || s == SdJobState::Running;
+}
+
+template <typename Fn>
+static void runSdJob(volatile SdJobState& job, Fn fn)
+{
+  if (job != SdJobState::Queued) return;
+  if (!runner || !runner->isStopped() || !ensureSdMounted(false)) { job = SdJobState::Failed; return; }
+
+  job = SdJobState::Running;
+  bool ok;
+  {
+    SdGuard sdg(true);
+    ok = sdg.locked && fn();
+  }
+  job = ok ? SdJobState::Done : SdJobState::Failed;
+}
+
+static void serviceSdJobs()
+{
+  runSdJob(gIndexJob, [] { return runner->buildCommandsIndex(gIndexStats); });
+  runSdJob(gConvertJob, [] { return runner->convertCommands(gConvertStats); });
+}
+
 static bool isSafePath(const String& p)
 {
   if (p.isEmpty()) return false;
@@ -403,6 +470,7 @@ static void registerDiagnosticsEndpoints(AsyncWebServer* server)
     if (movement) movement->getTcpOffset(tcpx, tcpy);
     doc["tcpOffsetXmm"] = tcpx;
     doc["tcpOffsetYmm"] = tcpy;
+    doc["topDistance"]  = movement ? movement->getTopDistance() : -1;
 
     doc["pulseLeftUs"]  = movement ? movement->getLeftPulseWidthUs()  : 0;
     doc["pulseRightUs"] = movement ? movement->getRightPulseWidthUs() : 0;
@@ -436,6 +504,7 @@ static void registerDiagnosticsEndpoints(AsyncWebServer* server)
     doc["d_m"] = (double)d_m;
 
     doc["belt_elongation_coefficient"] = (double)belt_elongation_coefficient;
+    doc["kin_float"] = sizeof(KinScalar) == sizeof(float);
 
     doc["HOME_Y_OFFSET_MM"] = (int)HOME_Y_OFFSET_MM;
     doc["safeYFraction"]    = (double)safeYFraction;
@@ -453,6 +522,76 @@ static void registerDiagnosticsEndpoints(AsyncWebServer* server)
     doc["perf_phase_ms"]    = (double)gPerf.phase_us_avg / 1000.0;
     doc["perf_max_loop_ms"] = (double)gPerf.max_loop_us / 1000.0;
 
+    doc["stream_enabled"]   = movement ? movement->isStreaming() : false;
+    doc["stream_underruns"] = movement ? movement->getStreamUnderruns() : 0;
+    doc["stream_errors"]    = movement ? movement->getStreamErrors() : 0;
+    doc["shaper_hz"]        = movement ? movement->getShaperHz() : 0.0;
+
+    doc["ik_table_ready"]      = movement ? movement->isIkTableReady() : false;
+    doc["ik_table_bytes"]      = movement ? (uint32_t)movement->getIkTableBytes() : 0;
+    doc["ik_table_max_err_mm"] = movement ? movement->getIkTableMaxErrorMM() : 0.0;
+    doc["ik_newton_fallbacks"] = movement ? movement->getIkNewtonFallbacks() : 0;
+
+    doc["sd_prefetch_depth"]  = runner ? runner->getSdPrefetchDepth() : 0;
+    doc["sd_prefetch_ready"]  = runner ? runner->getSdPrefetchReady() : 0;
+    doc["sd_prefetch_stalls"] = runner ? runner->getSdPrefetchStalls() : 0;
+    doc["sd_read_worst_us"]   = runner ? runner->getSdWorstReadUs() : 0;
+
+    String out;
+    serializeJson(doc, out);
+    request->send(200, "application/json; charset=utf-8", out);
+  });
+
+  // IK solver microbenchmark: /diag/ikBench?calls=2000 (blocks the request for its duration)
+  server->on("/diag/ikBench", HTTP_GET, [](AsyncWebServerRequest* request) {
+    if (!movement) { request->send(503, "text/plain", "Movement not ready"); return; }
+    if (movement->getTopDistance() <= 0) { request->send(409, "text/plain", "Top distance not set"); return; }
+    // the solver state is shared with the loop: only while nothing else uses it
+    if (!runner || !runner->isStopped()) { request->send(409, "text/plain", "Stop required"); return; }
+    if (movement->isMoving()) { request->send(409, "text/plain", "Busy (moving)"); return; }
+    if (movement->isIkTableBuilding()) { request->send(409, "text/plain", "Busy (IK table build)"); return; }
+
+    int calls = 1000;
+    if (request->hasParam("calls")) calls = request->getParam("calls")->value().toInt();
+
+    const Movement::IkBenchmark b = movement->runIkBenchmark(calls);
+
+    StaticJsonDocument<384> doc;
+    doc["calls"]               = b.calls;
+    doc["scan_calls_per_s"]    = b.scanCallsPerSec;
+    doc["newton_calls_per_s"]  = b.newtonCallsPerSec;
+    doc["table_calls_per_s"]   = b.tableCallsPerSec;
+    doc["newton_speedup"]      = (b.scanCallsPerSec > 0.0) ? b.newtonCallsPerSec / b.scanCallsPerSec : 0.0;
+    doc["max_gamma_diff_deg"]  = b.maxGammaDiffDeg;
+    doc["newton_fallbacks"]    = b.newtonFallbacks;
+
+    String out;
+    serializeJson(doc, out);
+    request->send(200, "application/json; charset=utf-8", out);
+  });
+
+  // float vs double kinematics kernel: /diag/kinAccuracy?grid=33
+  server->on("/diag/kinAccuracy", HTTP_GET, [](AsyncWebServerRequest* request) {
+    if (!movement) { request->send(503, "text/plain", "Movement not ready"); return; }
+    if (movement->getTopDistance() <= 0) { request->send(409, "text/plain", "Top distance not set"); return; }
+    if (!runner || !runner->isStopped()) { request->send(409, "text/plain", "Stop required"); return; }
+    if (movement->isMoving()) { request->send(409, "text/plain", "Busy (moving)"); return; }
+    if (movement->isIkTableBuilding()) { request->send(409, "text/plain", "Busy (IK table build)"); return; }
+
+    int grid = 33;
+    if (request->hasParam("grid")) grid = request->getParam("grid")->value().toInt();
+
+    const Movement::KinAccuracy a = movement->runKinematicsAccuracy(grid);
+
+    StaticJsonDocument<384> doc;
+    doc["kernel"]              = a.singlePrecision ? "float" : "double";
+    doc["points"]              = a.points;
+    doc["max_step_error"]      = a.maxStepError;
+    doc["mean_step_error"]     = a.meanStepError;
+    doc["step_mismatches"]     = a.stepMismatches;
+    doc["double_calls_per_s"]  = a.doubleCallsPerSec;
+    doc["float_calls_per_s"]   = a.floatCallsPerSec;
+
     String out;
     serializeJson(doc, out);
     request->send(200, "application/json; charset=utf-8", out);
@@ -1037,16 +1176,37 @@ void setup()
   Movement::PlannerConfig cfg = movement->getPlannerConfig();
   cfg.junctionDeviationMM = prefs.getDouble(PREF_KEY_JUNC_DEV, cfg.junctionDeviationMM);
   cfg.lookaheadSegments   = prefs.getInt(PREF_KEY_LOOKAHEAD, cfg.lookaheadSegments);
+  cfg.lookaheadSeconds    = prefs.getDouble(PREF_KEY_LOOKAHEAD_S, cfg.lookaheadSeconds);
   cfg.minSegmentTimeMs    = prefs.getInt(PREF_KEY_MINSEGMS, cfg.minSegmentTimeMs);
   cfg.cornerSlowdown      = prefs.getDouble(PREF_KEY_CORNERSLOW, cfg.cornerSlowdown);
   cfg.minCornerFactor     = prefs.getDouble(PREF_KEY_MINCORNER, cfg.minCornerFactor);
   cfg.minSegmentLenMM     = prefs.getDouble(PREF_KEY_MINSEGLEN, cfg.minSegmentLenMM);
   cfg.collinearDeg        = prefs.getDouble(PREF_KEY_COLLINEAR, cfg.collinearDeg);
+  cfg.simplifyToleranceMM = prefs.getDouble(PREF_KEY_SIMPLIFY, cfg.simplifyToleranceMM);
   cfg.microSlowLenMM      = prefs.getDouble(PREF_KEY_MICRO_LEN, cfg.microSlowLenMM);
   cfg.microMinFactor      = prefs.getDouble(PREF_KEY_MICRO_MINF, cfg.microMinFactor);
   cfg.backlashXmm         = prefs.getDouble(PREF_KEY_BACKLASHX, cfg.backlashXmm);
   cfg.backlashYmm         = prefs.getDouble(PREF_KEY_BACKLASHY, cfg.backlashYmm);
   cfg.sCurveFactor        = prefs.getDouble(PREF_KEY_SCURVE, cfg.sCurveFactor);
+  cfg.maxJerk             = prefs.getDouble(PREF_KEY_MAX_JERK, cfg.maxJerk);
+  cfg.shaperType          = prefs.getInt(PREF_KEY_SHAPER, cfg.shaperType);
+  cfg.shaperFreqHz        = prefs.getDouble(PREF_KEY_SHAPER_HZ, cfg.shaperFreqHz);
+  cfg.shaperAuto          = prefs.getBool(PREF_KEY_SHAPER_AUTO, cfg.shaperAuto);
+  cfg.timeOptimal         = prefs.getBool(PREF_KEY_TOPP, cfg.timeOptimal);
+  cfg.dynamicAccel        = prefs.getBool(PREF_KEY_DYN_ACCEL, cfg.dynamicAccel);
+  cfg.curvatureSpeed      = prefs.getBool(PREF_KEY_CURVATURE, cfg.curvatureSpeed);
+  cfg.cornerBlendMM       = prefs.getDouble(PREF_KEY_BLEND, cfg.cornerBlendMM);
+  cfg.gravityAccelGain    = prefs.getDouble(PREF_KEY_GRAV_GAIN, cfg.gravityAccelGain);
+  cfg.beltMinForceN       = prefs.getDouble(PREF_KEY_BELT_MINF, cfg.beltMinForceN);
+  cfg.beltMaxForceN       = prefs.getDouble(PREF_KEY_BELT_MAXF, cfg.beltMaxForceN);
+  cfg.streamMotion        = prefs.getBool(PREF_KEY_STREAM, cfg.streamMotion);
+  cfg.ikTable             = prefs.getBool(PREF_KEY_IKTABLE, cfg.ikTable);
+  cfg.ikNewton            = prefs.getBool(PREF_KEY_IKNEWTON, cfg.ikNewton);
+  cfg.ikToleranceDeg      = prefs.getDouble(PREF_KEY_IKTOL, cfg.ikToleranceDeg);
+  cfg.beltSpaceTravel     = prefs.getBool(PREF_KEY_BELTTRAVEL, cfg.beltSpaceTravel);
+  cfg.maxDeviationMM      = prefs.getDouble(PREF_KEY_MAXDEV, cfg.maxDeviationMM);
+  cfg.feedMode            = prefs.getBool(PREF_KEY_FEEDMODE, cfg.feedMode);
+  cfg.maxStepRate         = prefs.getInt(PREF_KEY_MAXSTEPR, cfg.maxStepRate);
   movement->setPlannerConfig(cfg);
 
   const int storedPenSettle = prefs.getInt(PREF_KEY_PEN_SETTLE, 0);
@@ -1099,6 +1259,7 @@ void setup()
     auto p = movement ? movement->getCoordinatesLive() : Movement::Point();
     doc["x"] = (double)p.x;
     doc["y"] = (double)p.y;
+    doc["speed_mm_s"] = movement ? movement->getMeasuredSpeedMmS() : 0.0;
 
     const int prog = runner ? runner->getProgress() : 0;
     const bool running = runner ? !runner->isStopped() : false;
@@ -1153,16 +1314,37 @@ void setup()
     auto pcfg = movement ? movement->getPlannerConfig() : Movement::PlannerConfig();
     plannerObj["junctionDeviation"] = pcfg.junctionDeviationMM;
     plannerObj["lookaheadSegments"] = pcfg.lookaheadSegments;
+    plannerObj["lookaheadSeconds"]  = pcfg.lookaheadSeconds;
     plannerObj["minSegmentTimeMs"]  = pcfg.minSegmentTimeMs;
     plannerObj["cornerSlowdown"]    = pcfg.cornerSlowdown;
     plannerObj["minCornerFactor"]   = pcfg.minCornerFactor;
     plannerObj["minSegmentLenMM"]   = pcfg.minSegmentLenMM;
     plannerObj["collinearDeg"]      = pcfg.collinearDeg;
+    plannerObj["simplifyToleranceMM"] = pcfg.simplifyToleranceMM;
     plannerObj["microSlowLenMM"]    = pcfg.microSlowLenMM;
     plannerObj["microMinFactor"]    = pcfg.microMinFactor;
     plannerObj["backlashXmm"]       = pcfg.backlashXmm;
     plannerObj["backlashYmm"]       = pcfg.backlashYmm;
     plannerObj["sCurveFactor"]      = pcfg.sCurveFactor;
+    plannerObj["maxJerk"]           = pcfg.maxJerk;
+    plannerObj["shaperType"]        = pcfg.shaperType;
+    plannerObj["shaperFreqHz"]      = pcfg.shaperFreqHz;
+    plannerObj["shaperAuto"]        = pcfg.shaperAuto;
+    plannerObj["timeOptimal"]       = pcfg.timeOptimal;
+    plannerObj["dynamicAccel"]      = pcfg.dynamicAccel;
+    plannerObj["curvatureSpeed"]    = pcfg.curvatureSpeed;
+    plannerObj["cornerBlendMM"]     = pcfg.cornerBlendMM;
+    plannerObj["gravityAccelGain"]  = pcfg.gravityAccelGain;
+    plannerObj["beltMinForceN"]     = pcfg.beltMinForceN;
+    plannerObj["beltMaxForceN"]     = pcfg.beltMaxForceN;
+    plannerObj["streamMotion"]      = pcfg.streamMotion;
+    plannerObj["ikTable"]           = pcfg.ikTable;
+    plannerObj["ikNewton"]          = pcfg.ikNewton;
+    plannerObj["ikToleranceDeg"]    = pcfg.ikToleranceDeg;
+    plannerObj["beltSpaceTravel"]   = pcfg.beltSpaceTravel;
+    plannerObj["maxDeviationMM"]    = pcfg.maxDeviationMM;
+    plannerObj["feedMode"]          = pcfg.feedMode;
+    plannerObj["maxStepRate"]       = pcfg.maxStepRate;
 
     plannerObj["penSettleMs"]       = runner ? runner->getPenSettleMs() : 0;
 
@@ -1201,6 +1383,67 @@ void setup()
     String out; serializeJson(doc, out);
     request->send(200, "application/json; charset=utf-8", out);
   });
+
+  // Rewrite a text /commands in the binary format (text kept as /commands.txt).
+  // Runs from loop() like /indexCommands; poll GET /convertCommands.
+  server.on("/convertCommands", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!runner) { request->send(503, "text/plain", "Runner not ready"); return; }
+
+    // Line numbers of a paused job would not survive skipped text lines.
+    if (!runner->isStopped()) {
+      request->send(409, "text/plain", "Stop required");
+      return;
+    }
+    if (sdJobBusy(gConvertJob)) { request->send(409, "text/plain", "Conversion running"); return; }
+    if (!ensureSdMounted(false)) { request->send(503, "text/plain", "SD not available"); return; }
+
+    gConvertJob = SdJobState::Queued;
+    request->send(202, "application/json; charset=utf-8", "{\"ok\":true,\"state\":\"queued\"}");
+  });
+
+  server.on("/convertCommands", HTTP_GET, [](AsyncWebServerRequest *request) {
+    const SdJobState state = gConvertJob;
+    StaticJsonDocument<256> doc;
+    doc["state"] = sdJobStateName(state);
+    if (state == SdJobState::Done) {
+      doc["alreadyBinary"] = gConvertStats.alreadyBinary;
+      doc["commands"] = (uint32_t)gConvertStats.commands;
+      doc["skippedLines"] = (uint32_t)gConvertStats.skippedLines;
+      doc["inBytes"] = (uint32_t)gConvertStats.inBytes;
+      doc["outBytes"] = (uint32_t)gConvertStats.outBytes;
+    }
+    String out; serializeJson(doc, out);
+    request->send(200, "application/json; charset=utf-8", out);
+  });
+
+  // Build the restart index of /commands ahead of time (otherwise on the first deep restart).
+  // The scan reads the whole file, so it runs from loop(); poll GET /indexCommands.
+  server.on("/indexCommands", HTTP_POST, [](AsyncWebServerRequest *request) {
+    if (!runner) { request->send(503, "text/plain", "Runner not ready"); return; }
+    if (!runner->isStopped()) {
+      request->send(409, "text/plain", "Stop required");
+      return;
+    }
+    if (sdJobBusy(gIndexJob)) { request->send(409, "text/plain", "Index build running"); return; }
+    if (!ensureSdMounted(false)) { request->send(503, "text/plain", "SD not available"); return; }
+
+    gIndexJob = SdJobState::Queued;
+    request->send(202, "application/json; charset=utf-8", "{\"ok\":true,\"state\":\"queued\"}");
+  });
+
+  server.on("/indexCommands", HTTP_GET, [](AsyncWebServerRequest *request) {
+    const SdJobState state = gIndexJob;
+    StaticJsonDocument<192> doc;
+    doc["state"] = sdJobStateName(state);
+    if (state == SdJobState::Done) {
+      doc["commands"] = (uint32_t)gIndexStats.commands;
+      doc["entries"] = (uint32_t)gIndexStats.entries;
+      doc["interval"] = (uint32_t)COMMANDS_INDEX_INTERVAL;
+      doc["buildMs"] = (uint32_t)gIndexStats.buildMs;
+    }
+    String out; serializeJson(doc, out);
+    request->send(200, "application/json; charset=utf-8", out);
+  });
 server.on("/setPenMergeMm", HTTP_POST, [](AsyncWebServerRequest *request){
     if (!runner) { request->send(503, "application/json; charset=utf-8", "{\"ok\":false,\"error\":\"Not ready\"}"); return; }
     if (!request->hasParam("mm", true)) { request->send(400, "application/json; charset=utf-8", "{\"ok\":false,\"error\":\"Missing mm\"}"); return; }
@@ -1442,16 +1685,37 @@ server.on("/pauseJob", HTTP_POST, [](AsyncWebServerRequest *request){
 
     if (request->hasParam("junctionDeviation", true)) cfg.junctionDeviationMM = request->getParam("junctionDeviation", true)->value().toDouble();
     if (request->hasParam("lookaheadSegments", true)) cfg.lookaheadSegments = request->getParam("lookaheadSegments", true)->value().toInt();
+    if (request->hasParam("lookaheadSeconds", true)) cfg.lookaheadSeconds = request->getParam("lookaheadSeconds", true)->value().toDouble();
     if (request->hasParam("minSegmentTimeMs", true)) cfg.minSegmentTimeMs = request->getParam("minSegmentTimeMs", true)->value().toInt();
     if (request->hasParam("cornerSlowdown", true)) cfg.cornerSlowdown = request->getParam("cornerSlowdown", true)->value().toDouble();
     if (request->hasParam("minCornerFactor", true)) cfg.minCornerFactor = request->getParam("minCornerFactor", true)->value().toDouble();
     if (request->hasParam("minSegmentLenMM", true)) cfg.minSegmentLenMM = request->getParam("minSegmentLenMM", true)->value().toDouble();
     if (request->hasParam("collinearDeg", true)) cfg.collinearDeg = request->getParam("collinearDeg", true)->value().toDouble();
+    if (request->hasParam("simplifyToleranceMM", true)) cfg.simplifyToleranceMM = request->getParam("simplifyToleranceMM", true)->value().toDouble();
     if (request->hasParam("microSlowLenMM", true)) cfg.microSlowLenMM = request->getParam("microSlowLenMM", true)->value().toDouble();
     if (request->hasParam("microMinFactor", true)) cfg.microMinFactor = request->getParam("microMinFactor", true)->value().toDouble();
     if (request->hasParam("backlashXmm", true)) cfg.backlashXmm = request->getParam("backlashXmm", true)->value().toDouble();
     if (request->hasParam("backlashYmm", true)) cfg.backlashYmm = request->getParam("backlashYmm", true)->value().toDouble();
     if (request->hasParam("sCurveFactor", true)) cfg.sCurveFactor = request->getParam("sCurveFactor", true)->value().toDouble();
+    if (request->hasParam("maxJerk", true)) cfg.maxJerk = request->getParam("maxJerk", true)->value().toDouble();
+    if (request->hasParam("shaperType", true)) cfg.shaperType = request->getParam("shaperType", true)->value().toInt();
+    if (request->hasParam("shaperFreqHz", true)) cfg.shaperFreqHz = request->getParam("shaperFreqHz", true)->value().toDouble();
+    if (request->hasParam("shaperAuto", true)) cfg.shaperAuto = request->getParam("shaperAuto", true)->value().toInt() != 0;
+    if (request->hasParam("timeOptimal", true)) cfg.timeOptimal = request->getParam("timeOptimal", true)->value().toInt() != 0;
+    if (request->hasParam("dynamicAccel", true)) cfg.dynamicAccel = request->getParam("dynamicAccel", true)->value().toInt() != 0;
+    if (request->hasParam("curvatureSpeed", true)) cfg.curvatureSpeed = request->getParam("curvatureSpeed", true)->value().toInt() != 0;
+    if (request->hasParam("cornerBlendMM", true)) cfg.cornerBlendMM = request->getParam("cornerBlendMM", true)->value().toDouble();
+    if (request->hasParam("gravityAccelGain", true)) cfg.gravityAccelGain = request->getParam("gravityAccelGain", true)->value().toDouble();
+    if (request->hasParam("beltMinForceN", true)) cfg.beltMinForceN = request->getParam("beltMinForceN", true)->value().toDouble();
+    if (request->hasParam("beltMaxForceN", true)) cfg.beltMaxForceN = request->getParam("beltMaxForceN", true)->value().toDouble();
+    if (request->hasParam("streamMotion", true)) cfg.streamMotion = request->getParam("streamMotion", true)->value().toInt() != 0;
+    if (request->hasParam("ikTable", true)) cfg.ikTable = request->getParam("ikTable", true)->value().toInt() != 0;
+    if (request->hasParam("ikNewton", true)) cfg.ikNewton = request->getParam("ikNewton", true)->value().toInt() != 0;
+    if (request->hasParam("ikToleranceDeg", true)) cfg.ikToleranceDeg = request->getParam("ikToleranceDeg", true)->value().toDouble();
+    if (request->hasParam("beltSpaceTravel", true)) cfg.beltSpaceTravel = request->getParam("beltSpaceTravel", true)->value().toInt() != 0;
+    if (request->hasParam("maxDeviationMM", true)) cfg.maxDeviationMM = request->getParam("maxDeviationMM", true)->value().toDouble();
+    if (request->hasParam("feedMode", true)) cfg.feedMode = request->getParam("feedMode", true)->value().toInt() != 0;
+    if (request->hasParam("maxStepRate", true)) cfg.maxStepRate = request->getParam("maxStepRate", true)->value().toInt();
 
     int penSettleMs = runner ? runner->getPenSettleMs() : 0;
     if (request->hasParam("penSettleMs", true)) penSettleMs = request->getParam("penSettleMs", true)->value().toInt();
@@ -1463,16 +1727,37 @@ server.on("/pauseJob", HTTP_POST, [](AsyncWebServerRequest *request){
 
     prefs.putDouble(PREF_KEY_JUNC_DEV, cfg.junctionDeviationMM);
     prefs.putInt(PREF_KEY_LOOKAHEAD, cfg.lookaheadSegments);
+    prefs.putDouble(PREF_KEY_LOOKAHEAD_S, cfg.lookaheadSeconds);
     prefs.putInt(PREF_KEY_MINSEGMS, cfg.minSegmentTimeMs);
     prefs.putDouble(PREF_KEY_CORNERSLOW, cfg.cornerSlowdown);
     prefs.putDouble(PREF_KEY_MINCORNER, cfg.minCornerFactor);
     prefs.putDouble(PREF_KEY_MINSEGLEN, cfg.minSegmentLenMM);
     prefs.putDouble(PREF_KEY_COLLINEAR, cfg.collinearDeg);
+    prefs.putDouble(PREF_KEY_SIMPLIFY, cfg.simplifyToleranceMM);
     prefs.putDouble(PREF_KEY_MICRO_LEN, cfg.microSlowLenMM);
     prefs.putDouble(PREF_KEY_MICRO_MINF, cfg.microMinFactor);
     prefs.putDouble(PREF_KEY_BACKLASHX, cfg.backlashXmm);
     prefs.putDouble(PREF_KEY_BACKLASHY, cfg.backlashYmm);
     prefs.putDouble(PREF_KEY_SCURVE, cfg.sCurveFactor);
+    prefs.putDouble(PREF_KEY_MAX_JERK, cfg.maxJerk);
+    prefs.putInt(PREF_KEY_SHAPER, cfg.shaperType);
+    prefs.putDouble(PREF_KEY_SHAPER_HZ, cfg.shaperFreqHz);
+    prefs.putBool(PREF_KEY_SHAPER_AUTO, cfg.shaperAuto);
+    prefs.putBool(PREF_KEY_TOPP, cfg.timeOptimal);
+    prefs.putBool(PREF_KEY_DYN_ACCEL, cfg.dynamicAccel);
+    prefs.putBool(PREF_KEY_CURVATURE, cfg.curvatureSpeed);
+    prefs.putDouble(PREF_KEY_BLEND, cfg.cornerBlendMM);
+    prefs.putDouble(PREF_KEY_GRAV_GAIN, cfg.gravityAccelGain);
+    prefs.putDouble(PREF_KEY_BELT_MINF, cfg.beltMinForceN);
+    prefs.putDouble(PREF_KEY_BELT_MAXF, cfg.beltMaxForceN);
+    prefs.putBool(PREF_KEY_STREAM, cfg.streamMotion);
+    prefs.putBool(PREF_KEY_IKTABLE, cfg.ikTable);
+    prefs.putBool(PREF_KEY_IKNEWTON, cfg.ikNewton);
+    prefs.putDouble(PREF_KEY_IKTOL, cfg.ikToleranceDeg);
+    prefs.putBool(PREF_KEY_BELTTRAVEL, cfg.beltSpaceTravel);
+    prefs.putDouble(PREF_KEY_MAXDEV, cfg.maxDeviationMM);
+    prefs.putBool(PREF_KEY_FEEDMODE, cfg.feedMode);
+    prefs.putInt(PREF_KEY_MAXSTEPR, cfg.maxStepRate);
 
     prefs.putInt(PREF_KEY_PEN_SETTLE, penSettleMs);
 
@@ -1702,11 +1987,13 @@ server.on("/pauseJob", HTTP_POST, [](AsyncWebServerRequest *request){
       request->send(503, "text/plain", "SD busy");
       return;
     }
-    if (!SD.exists("/commands")) {
+    // the UI parses text: a binary job is served from its text copy
+    const String path = commandsTextPath();
+    if (path.length() == 0) {
       request->send(404, "text/plain", "commands not found");
       return;
     }
-    request->send(SD, "/commands", "text/plain");
+    request->send(SD, path, "text/plain");
   });
 
   if (gLittleFsMounted) {
@@ -1758,6 +2045,7 @@ void loop()
   const uint32_t t2 = micros();
 
   runner->run();
+  serviceSdJobs();
   const uint32_t t3 = micros();
 
   if (phaseManager->getCurrentPhase()) {
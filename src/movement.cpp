@@ -4,6 +4,7 @@
 
 #include "display.h"
 #include "movement.h"
+#include "command_format.h"
 #include "service/weblog.h"
 
 int printSpeedSteps = 1200;
@@ -26,6 +27,9 @@ Movement::Movement(Display* display) {
     rightMotor->setAcceleration((float)accelerationSteps);
     rightMotor->setMinPulseWidth(_rightPulseWidthUs); // no-op on FastAccelStepper, kept for API compatibility
     rightMotor->disableOutputs();
+
+    stream = new StepStream(leftMotor, rightMotor);
+
     topDistance = -1;
     moving = false;
     homed = false;
@@ -36,12 +40,15 @@ Movement::Movement(Display* display) {
 }
 
 void Movement::setPlannerConfig(const PlannerConfig& cfg) {
+    const bool solverChanged = (cfg.ikNewton != plannerCfg.ikNewton) || (cfg.ikToleranceDeg != plannerCfg.ikToleranceDeg);
     plannerCfg = cfg;
 
     if (plannerCfg.junctionDeviationMM < 0.001) plannerCfg.junctionDeviationMM = 0.001;
     if (plannerCfg.junctionDeviationMM > 5.0) plannerCfg.junctionDeviationMM = 5.0;
     if (plannerCfg.lookaheadSegments < 1) plannerCfg.lookaheadSegments = 1;
     if (plannerCfg.lookaheadSegments > 512) plannerCfg.lookaheadSegments = 512;
+    if (!(plannerCfg.lookaheadSeconds >= 0.0)) plannerCfg.lookaheadSeconds = 0.0;
+    if (plannerCfg.lookaheadSeconds > 10.0) plannerCfg.lookaheadSeconds = 10.0;
     if (plannerCfg.minSegmentTimeMs < 0) plannerCfg.minSegmentTimeMs = 0;
     if (plannerCfg.minSegmentTimeMs > 400) plannerCfg.minSegmentTimeMs = 400;
     if (plannerCfg.cornerSlowdown < 0.05) plannerCfg.cornerSlowdown = 0.05;
@@ -50,15 +57,50 @@ void Movement::setPlannerConfig(const PlannerConfig& cfg) {
     if (plannerCfg.minCornerFactor > 1.0) plannerCfg.minCornerFactor = 1.0;
     if (plannerCfg.sCurveFactor < 0.0) plannerCfg.sCurveFactor = 0.0;
     if (plannerCfg.sCurveFactor > 2.0) plannerCfg.sCurveFactor = 2.0;
+    if (!(plannerCfg.maxJerk >= 0.0)) plannerCfg.maxJerk = 0.0;
+    if (plannerCfg.maxJerk > 1000000.0) plannerCfg.maxJerk = 1000000.0;
+    if (plannerCfg.shaperType < 0 || plannerCfg.shaperType > 3) plannerCfg.shaperType = 0;
+    if (!(plannerCfg.shaperFreqHz >= 0.5)) plannerCfg.shaperFreqHz = 0.5;
+    if (plannerCfg.shaperFreqHz > 50.0) plannerCfg.shaperFreqHz = 50.0;
+    if (!(plannerCfg.cornerBlendMM >= 0.0)) plannerCfg.cornerBlendMM = 0.0;
+    if (plannerCfg.cornerBlendMM > 2.0) plannerCfg.cornerBlendMM = 2.0;
+    if (!(plannerCfg.gravityAccelGain >= 0.0)) plannerCfg.gravityAccelGain = 0.0;
+    if (plannerCfg.gravityAccelGain > 0.9) plannerCfg.gravityAccelGain = 0.9;
+    if (!(plannerCfg.beltMinForceN >= 0.0)) plannerCfg.beltMinForceN = 0.0;
+    if (plannerCfg.beltMinForceN > 50.0) plannerCfg.beltMinForceN = 50.0;
+    if (!(plannerCfg.beltMaxForceN >= plannerCfg.beltMinForceN + 1.0)) plannerCfg.beltMaxForceN = plannerCfg.beltMinForceN + 1.0;
+    if (plannerCfg.beltMaxForceN > 200.0) plannerCfg.beltMaxForceN = 200.0;
     if (plannerCfg.minSegmentLenMM < 0.0) plannerCfg.minSegmentLenMM = 0.0;
     if (plannerCfg.minSegmentLenMM > 20.0) plannerCfg.minSegmentLenMM = 20.0;
     if (plannerCfg.collinearDeg < 0.1) plannerCfg.collinearDeg = 0.1;
     if (plannerCfg.collinearDeg > 45.0) plannerCfg.collinearDeg = 45.0;
+    if (!(plannerCfg.simplifyToleranceMM >= 0.0)) plannerCfg.simplifyToleranceMM = 0.0;
+    if (plannerCfg.simplifyToleranceMM > 0.5) plannerCfg.simplifyToleranceMM = 0.5;
 
     if (plannerCfg.microSlowLenMM < 0.0) plannerCfg.microSlowLenMM = 0.0;
     if (plannerCfg.microSlowLenMM > 20.0) plannerCfg.microSlowLenMM = 20.0;
     if (plannerCfg.microMinFactor < 0.05) plannerCfg.microMinFactor = 0.05;
     if (plannerCfg.microMinFactor > 1.0) plannerCfg.microMinFactor = 1.0;
+    if (!(plannerCfg.ikToleranceDeg >= 0.00001)) plannerCfg.ikToleranceDeg = 0.00001;
+    if (plannerCfg.ikToleranceDeg > 0.2) plannerCfg.ikToleranceDeg = 0.2;
+    if (!(plannerCfg.maxDeviationMM >= 0.0)) plannerCfg.maxDeviationMM = 0.0;
+    if (plannerCfg.maxStepRate < 100) plannerCfg.maxStepRate = 100;
+    if (plannerCfg.maxStepRate > 40000) plannerCfg.maxStepRate = 40000;
+    if (plannerCfg.maxDeviationMM > 1.0) plannerCfg.maxDeviationMM = 1.0;
+
+    if (stream) {
+        stream->setJerk(plannerCfg.maxJerk);
+        stream->setShaper((StepStream::Shaper)plannerCfg.shaperType, plannerCfg.shaperFreqHz);
+    }
+
+    if (!plannerCfg.ikTable) {
+        ikTableReady = false;
+        ikTableDirty = false;
+    } else if ((solverChanged || (!ikTableReady && ikBuildRow < 0)) && topDistance > 0) {
+        // table samples the selected solver
+        ikTableReady = false;
+        ikTableDirty = true;
+    }
 }
 
 Movement::PlannerConfig Movement::getPlannerConfig() const {
@@ -71,6 +113,13 @@ void Movement::setTopDistance(const int distance) {
     minSafeY = safeYFraction * topDistance;
     minSafeXOffset = safeXFraction * topDistance;
     width = topDistance - 2 * minSafeXOffset;
+    kinGeometry = makeGeometry<KinScalar>();
+    fk.valid = false;
+    fk.hasSample = false;
+
+    // geometry changed: fall back to the exact solve until the table is rebuilt
+    ikTableReady = false;
+    ikTableDirty = plannerCfg.ikTable;
 }
 
 void Movement::resumeTopDistance(int distance) {
@@ -82,6 +131,8 @@ void Movement::resumeTopDistance(int distance) {
     Y = homeCoordinates.y;
     lastSegmentDX = 0.0;
     lastSegmentDY = 0.0;
+    lastBeltDL = 0;
+    lastBeltDR = 0;
     lastDirX = 0;
     lastDirY = 0;
 
@@ -97,6 +148,7 @@ void Movement::setOrigin() {
     leftMotor->setCurrentPosition(hs);
     rightMotor->setCurrentPosition(hs);
     homed = true;
+    fk.valid = false;
 }
 
 void Movement::leftStepper(const int dir) {
@@ -106,7 +158,7 @@ void Movement::leftStepper(const int dir) {
     leftMotor->setMinPulseWidth(_leftPulseWidthUs);
 
     const float accel = (float)std::max(1.0, (double)accelerationSteps);
-    const float vmax  = (float)std::max(1, printSpeedSteps);
+    const float vmax  = (float)std::max(1.0, motorStepsPerSec(printSpeedSteps));
 
     leftMotor->setAcceleration(accel);
     leftMotor->setMaxSpeed(vmax);
@@ -129,7 +181,7 @@ void Movement::rightStepper(const int dir) {
     rightMotor->setMinPulseWidth(_rightPulseWidthUs);
 
     const float accel = (float)std::max(1.0, (double)accelerationSteps);
-    const float vmax  = (float)std::max(1, printSpeedSteps);
+    const float vmax  = (float)std::max(1.0, motorStepsPerSec(printSpeedSteps));
 
     rightMotor->setAcceleration(accel);
     rightMotor->setMaxSpeed(vmax);
@@ -162,7 +214,32 @@ int Movement::extendToHome() {
 }
 
 void Movement::runSteppers() {
-    if (!moving) return;
+    publishLiveSample(moving);
+    if (!moving) {
+        serviceIkTable();
+        return;
+    }
+
+    if (stream && stream->isActive()) {
+        stream->service();
+        if (!stream->isActive()) {
+            moving = false;
+            if (streamAborted) {
+                // stopped short of the queued target: continue from where it is
+                streamAborted = false;
+                Point p;
+                if (getMeasuredCoordinates(p)) {
+                    X = p.x - tcpOffsetXmm;
+                    Y = p.y - tcpOffsetYmm;
+                }
+                lastSegmentDX = 0.0;
+                lastSegmentDY = 0.0;
+                lastBeltDL = 0;
+                lastBeltDR = 0;
+            }
+        }
+        return;
+    }
 
     // run() uses acceleration profile (setAcceleration), runSpeedToPosition() does not
     leftMotor->run();
@@ -206,6 +283,89 @@ void Movement::getBeltForces(const double phi_L, const double phi_R, double& F_L
     F_L = F_G * cos(phi_R) / sin(phi_L + phi_R);
 }
 
+// Sideways swing of the hanging carriage: each belt acts as a spring of
+// stiffness tension/length across its direction.
+double Movement::swingFrequencyHz(const double x, const double y) const {
+    const double frameX = x + minSafeXOffset;
+    const double frameY = y + minSafeY;
+
+    double phi_L, phi_R, F_L, F_R;
+    getBeltAngles(frameX, frameY, gamma_last_position, phi_L, phi_R);
+    getBeltForces(phi_L, phi_R, F_L, F_R);
+
+    double x_PL, y_PL, x_PR, y_PR;
+    getLeftTangentPoint(frameX, frameY, gamma_last_position, x_PL, y_PL);
+    getRightTangentPoint(frameX, frameY, gamma_last_position, x_PR, y_PR);
+    const double lenL = std::max(1.0, kin::length<double>(x_PL, y_PL));
+    const double lenR = std::max(1.0, kin::length<double>(topDistance - x_PR, y_PR));
+
+    const double stiffness = (F_L / lenL + F_R / lenR) * 1000.0;  // N/m
+    if (!(stiffness > 0.0)) return 0.0;
+    return sqrt(stiffness / mass_bot) / (2.0 * PI);
+}
+
+// Belt force change for a carriage acceleration a (mm/s^2) along (ux, uy):
+// solving the force balance with m*a added gives dF = k * a per belt. A belt
+// whose k is positive tightens while speeding up and loosens while braking.
+void Movement::tensionAccelLimits(const double x, const double y, const double ux, const double uy,
+                                  double& accelMmS2, double& decelMmS2) const {
+    const double frameX = x + minSafeXOffset;
+    const double frameY = y + minSafeY;
+
+    double phi_L, phi_R, F_L, F_R;
+    getBeltAngles(frameX, frameY, gamma_last_position, phi_L, phi_R);
+    getBeltForces(phi_L, phi_R, F_L, F_R);
+
+    const double det = sin(phi_L + phi_R);
+    if (!(det > 1e-6)) return;
+
+    const double k = mass_bot / 1000.0 / det;  // N per mm/s^2
+    const double kL = k * (-sin(phi_R) * ux - cos(phi_R) * uy);
+    const double kR = k * (sin(phi_L) * ux - cos(phi_L) * uy);
+
+    const double fMin = plannerCfg.beltMinForceN;
+    const double fMax = plannerCfg.beltMaxForceN;
+    auto limit = [&](double kB, double F0) {
+        if (fabs(kB) < 1e-12) return;
+        const double up = std::max(0.0, fMax - F0) / fabs(kB);    // room to tighten
+        const double down = std::max(0.0, F0 - fMin) / fabs(kB);  // room to loosen
+        accelMmS2 = std::min(accelMmS2, kB > 0.0 ? up : down);
+        decelMmS2 = std::min(decelMmS2, kB > 0.0 ? down : up);
+    };
+    limit(kL, F_L);
+    limit(kR, F_R);
+}
+
+void Movement::dynamicAccelCarriage(const double fromX, const double fromY, const double toX, const double toY,
+                                    double& accelMmS2, double& decelMmS2) const {
+    if (!plannerCfg.dynamicAccel) return;
+
+    const double dx = toX - fromX;
+    const double dy = toY - fromY;
+    const double len = sqrt(dx * dx + dy * dy);
+    if (len < 1e-6) return;
+    const double ux = dx / len;
+    const double uy = dy / len;
+
+    // y grows downward: gravity helps a downward move speed up and an upward one stop
+    const double gain = plannerCfg.gravityAccelGain;
+    accelMmS2 *= 1.0 + gain * uy;
+    decelMmS2 *= 1.0 - gain * uy;
+
+    tensionAccelLimits(fromX, fromY, ux, uy, accelMmS2, decelMmS2);
+    tensionAccelLimits(toX, toY, ux, uy, accelMmS2, decelMmS2);
+
+    // never stall a move completely, even with the carriage at a force limit
+    constexpr double MIN_ACCEL_MM_S2 = 10.0;
+    accelMmS2 = std::max(accelMmS2, MIN_ACCEL_MM_S2);
+    decelMmS2 = std::max(decelMmS2, MIN_ACCEL_MM_S2);
+}
+
+void Movement::dynamicAccelLimits(Point fromPenTip, Point toPenTip, double& accelMmS2, double& decelMmS2) const {
+    dynamicAccelCarriage(fromPenTip.x - tcpOffsetXmm, fromPenTip.y - tcpOffsetYmm,
+                         toPenTip.x - tcpOffsetXmm, toPenTip.y - tcpOffsetYmm, accelMmS2, decelMmS2);
+}
+
 double Movement::solveTorqueEquilibrium(const double phi_L, const double phi_R, const double F_L, const double F_R, const double gamma_init) const {
     const double s_L = d_t / 2.0;
     const double s_R = d_t / 2.0;
@@ -247,13 +407,9 @@ inline double Movement::getDilationCorrectedBeltLength(double belt_length_mm, do
     return belt_length_mm / elongation_factor;
 }
 
-Movement::Lengths Movement::getBeltLengths(const double x, const double y) {
-    const double frameX = x + minSafeXOffset;
-    const double frameY = y + minSafeY;
-
-    double gamma = gamma_last_position;
+// Legacy solver: fixed-point iteration around the windowed gamma scan.
+void Movement::solveTiltScan(const double frameX, const double frameY, double& gamma, double& F_L, double& F_R) const {
     double phi_L = 0.0, phi_R = 0.0;
-    double F_L = 0.0, F_R = 0.0;
 
     constexpr int solver_max_iterations = 20;
     constexpr double gamma_delta_termination = 0.25 / 180.0 * PI;
@@ -267,25 +423,284 @@ Movement::Lengths Movement::getBeltLengths(const double x, const double y) {
 
         if (abs(gamma_last - gamma) < gamma_delta_termination) break;
     }
+}
+
+// Newton solve of the tilt in the KinScalar kernel, see kin::solveTiltNewton().
+bool Movement::solveTiltNewton(const double frameX, const double frameY, double& gamma, double& F_L, double& F_R) const {
+    KinScalar g = (KinScalar)gamma;
+    KinScalar fl, fr;
+    const KinScalar tolerance = (KinScalar)(plannerCfg.ikToleranceDeg * PI / 180.0);
+    if (!kin::solveTiltNewton<KinScalar>(kinGeometry, (KinScalar)frameX, (KinScalar)frameY, tolerance, g, fl, fr)) return false;
+
+    gamma = g;
+    F_L = fl;
+    F_R = fr;
+    return true;
+}
+
+void Movement::solveBeltLegs(const double x, const double y, double& leftLeg, double& rightLeg, double& gamma) {
+    const double frameX = x + minSafeXOffset;
+    const double frameY = y + minSafeY;
+
+    gamma = gamma_last_position;
+    double F_L = 0.0, F_R = 0.0;
+
+    if (!plannerCfg.ikNewton || !solveTiltNewton(frameX, frameY, gamma, F_L, F_R)) {
+        if (plannerCfg.ikNewton) ikNewtonFallbacks++;
+        gamma = gamma_last_position;
+        solveTiltScan(frameX, frameY, gamma, F_L, F_R);
+    }
 
     gamma_last_position = gamma;
 
-    double leftX, leftY, rightX, rightY;
-    getLeftTangentPoint(frameX, frameY, gamma, leftX, leftY);
-    getRightTangentPoint(frameX, frameY, gamma, rightX, rightY);
+    KinScalar l, r;
+    kin::beltLegs<KinScalar>(kinGeometry, (KinScalar)frameX, (KinScalar)frameY, (KinScalar)gamma, l, r);
+
+    leftLeg = getDilationCorrectedBeltLength(l, F_L);
+    rightLeg = getDilationCorrectedBeltLength(r, F_R);
+}
+
+// Belt lengths with the carriage held level (gamma = 0), closed form.
+void Movement::flatBeltLegs(const double x, const double y, double& leftLeg, double& rightLeg) const {
+    KinScalar l, r;
+    kin::flatBeltLegs<KinScalar>(kinGeometry, (KinScalar)(x + minSafeXOffset), (KinScalar)(y + minSafeY), l, r);
+    leftLeg = l;
+    rightLeg = r;
+}
+
+bool Movement::lookupBeltLegs(const double x, const double y, double& leftLeg, double& rightLeg) {
+    if (!ikTableReady || !plannerCfg.ikTable) return false;
+
+    double r[IkTable::CHANNELS];
+    if (!ikTable.lookup(x, y, r)) return false;
+
+    flatBeltLegs(x, y, leftLeg, rightLeg);
+    leftLeg += r[0];
+    rightLeg += r[1];
+
+    // keep the solver warm start close for points outside the grid
+    gamma_last_position = r[2];
+    return true;
+}
+
+bool Movement::isIkTableReady() const {
+    return ikTableReady && plannerCfg.ikTable;
+}
+
+// Builds one grid row per call while the machine is idle (a row is a few dozen
+// exact solves). The error is measured against the exact solve at cell centers.
+void Movement::serviceIkTable() {
+    // A table that moves a belt by a whole step somewhere is worse than the solve.
+    constexpr double IK_TABLE_MAX_ERR_MM = mmPerStep;
+
+    if (ikTableDirty) {
+        ikTableDirty = false;
+        ikTableReady = false;
+        ikBuildRow = -1;
+        ikTable.clear();
+
+        if (!plannerCfg.ikTable || topDistance <= 0) return;
+
+        if (!ikTable.allocate(0.0, 0.0, width, (double)topDistance)) {
+            WebLog::warn("IK table | allocation failed, using exact solve");
+            return;
+        }
+        ikBuildRow = 0;
+        ikBuildGamma = 0.0;
+        ikTableMaxErrMM = 0.0;
+        return;
+    }
+
+    if (ikBuildRow < 0) return;
+    if (!plannerCfg.ikTable) {
+        ikBuildRow = -1;
+        ikTable.clear();
+        return;
+    }
+
+    const double savedGamma = gamma_last_position;
+    const int iy = ikBuildRow;
+    gamma_last_position = ikBuildGamma;
+
+    for (int ix = 0; ix < IkTable::NODES; ix++) {
+        const double x = ikTable.nodeX(ix);
+        const double y = ikTable.nodeY(iy);
+
+        double leftLeg, rightLeg, gamma, leftFlat, rightFlat;
+        solveBeltLegs(x, y, leftLeg, rightLeg, gamma);
+        flatBeltLegs(x, y, leftFlat, rightFlat);
+        if (ix == 0) ikBuildGamma = gamma;  // warm start of the next row
+
+        const double r[IkTable::CHANNELS] = { leftLeg - leftFlat, rightLeg - rightFlat, gamma };
+        if (!ikTable.set(ix, iy, r)) {
+            WebLog::warn("IK table | residual out of range at (" + String(x, 1) + "," + String(y, 1) + "), using exact solve");
+            ikBuildRow = -1;
+            ikTable.clear();
+            gamma_last_position = savedGamma;
+            return;
+        }
+    }
 
-    const double leftLegFlat = sqrt(pow(leftX, 2) + pow(leftY, 2));
-    const double rightLegFlat = sqrt(pow(topDistance - rightX, 2) + pow(rightY, 2));
+    // Bilinear error peaks at the cell centers: check every cell of the finished row band.
+    if (iy > 0) {
+        for (int ix = 0; ix < IkTable::NODES - 1; ix++) {
+            const double x = 0.5 * (ikTable.nodeX(ix) + ikTable.nodeX(ix + 1));
+            const double y = 0.5 * (ikTable.nodeY(iy - 1) + ikTable.nodeY(iy));
 
-    double leftLeg = sqrt(pow(leftLegFlat, 2) + pow(midPulleyToWall, 2));
-    double rightLeg = sqrt(pow(rightLegFlat, 2) + pow(midPulleyToWall, 2));
+            double r[IkTable::CHANNELS];
+            if (!ikTable.lookup(x, y, r)) continue;
 
-    leftLeg = getDilationCorrectedBeltLength(leftLeg, F_L);
-    rightLeg = getDilationCorrectedBeltLength(rightLeg, F_R);
+            double leftLeg, rightLeg, gamma, leftFlat, rightFlat;
+            gamma_last_position = r[2];
+            solveBeltLegs(x, y, leftLeg, rightLeg, gamma);
+            flatBeltLegs(x, y, leftFlat, rightFlat);
+
+            const double err = std::max(fabs(leftFlat + r[0] - leftLeg), fabs(rightFlat + r[1] - rightLeg));
+            if (err > ikTableMaxErrMM) ikTableMaxErrMM = err;
+        }
+    }
+
+    gamma_last_position = savedGamma;
+
+    ikBuildRow++;
+    if (ikBuildRow < IkTable::NODES) return;
+    ikBuildRow = -1;
+
+    if (ikTableMaxErrMM > IK_TABLE_MAX_ERR_MM) {
+        WebLog::warn("IK table | max error " + String(ikTableMaxErrMM, 4) + " mm over one step, using exact solve");
+        ikTable.clear();
+        return;
+    }
+
+    ikTableReady = true;
+    WebLog::info("IK table | ready, " + String((unsigned)ikTable.bytes()) + " bytes, max error " + String(ikTableMaxErrMM, 4) + " mm");
+}
 
+Movement::Lengths Movement::getBeltLengths(const double x, const double y) {
+    double leftLeg, rightLeg;
+    if (!lookupBeltLegs(x, y, leftLeg, rightLeg)) {
+        double gamma;
+        solveBeltLegs(x, y, leftLeg, rightLeg, gamma);
+    }
     return Lengths(mmToSteps(leftLeg), mmToSteps(rightLeg));
 }
 
+// Times the tilt solvers on a closed path over the work area (consecutive
+// points are close, like a drawing, so warm starts behave as in a job).
+Movement::IkBenchmark Movement::runIkBenchmark(int calls) {
+    IkBenchmark res;
+    if (topDistance <= 0 || moving) return res;
+    if (calls < 10) calls = 10;
+    if (calls > 5000) calls = 5000;
+    res.calls = calls;
+
+    const double savedGamma = gamma_last_position;
+    const double w = width;
+    const double h = (double)topDistance;
+    auto pathX = [&](int k) { return w * (0.5 + 0.45 * sin(2.0 * PI * 3.0 * k / calls)); };
+    auto pathY = [&](int k) { return h * (0.5 + 0.45 * sin(2.0 * PI * 2.0 * k / calls + 0.5)); };
+
+    double F_L, F_R;
+
+    double gamma = 0.0;
+    uint32_t t0 = micros();
+    for (int k = 0; k < calls; k++) solveTiltScan(pathX(k) + minSafeXOffset, pathY(k) + minSafeY, gamma, F_L, F_R);
+    uint32_t dt = micros() - t0;
+    res.scanCallsPerSec = dt ? calls * 1e6 / dt : 0.0;
+
+    gamma = 0.0;
+    t0 = micros();
+    for (int k = 0; k < calls; k++) {
+        if (!solveTiltNewton(pathX(k) + minSafeXOffset, pathY(k) + minSafeY, gamma, F_L, F_R)) res.newtonFallbacks++;
+    }
+    dt = micros() - t0;
+    res.newtonCallsPerSec = dt ? calls * 1e6 / dt : 0.0;
+
+    if (isIkTableReady()) {
+        double l, r;
+        t0 = micros();
+        for (int k = 0; k < calls; k++) lookupBeltLegs(pathX(k), pathY(k), l, r);
+        dt = micros() - t0;
+        res.tableCallsPerSec = dt ? calls * 1e6 / dt : 0.0;
+    }
+
+    // accuracy: Newton against the scan, both warm started from the Newton answer
+    double gn = 0.0;
+    for (int k = 0; k < calls; k += 16) {
+        const double fx = pathX(k) + minSafeXOffset;
+        const double fy = pathY(k) + minSafeY;
+        if (!solveTiltNewton(fx, fy, gn, F_L, F_R)) continue;
+        double gs = gn;
+        solveTiltScan(fx, fy, gs, F_L, F_R);
+        const double diff = fabs(gs - gn) * 180.0 / PI;
+        if (diff > res.maxGammaDiffDeg) res.maxGammaDiffDeg = diff;
+    }
+
+    gamma_last_position = savedGamma;
+    return res;
+}
+
+namespace {
+
+template <typename T>
+uint32_t timeKernelRow(const kin::Geometry<T>& g, const double* xs, const double* ys, int n, T tolerance, double* outL, double* outR) {
+    T gamma = 0, F_L, F_R, l, r;
+    const uint32_t t0 = micros();
+    for (int i = 0; i < n; i++) {
+        const T fx = T(xs[i]) + g.originX;
+        const T fy = T(ys[i]) + g.originY;
+        kin::solveTiltNewton<T>(g, fx, fy, tolerance, gamma, F_L, F_R);
+        kin::beltLegs<T>(g, fx, fy, gamma, l, r);
+        outL[i] = l;
+        outR[i] = r;
+    }
+    return micros() - t0;
+}
+
+}  // namespace
+
+// Runs both kernel precisions over a gridN x gridN raster of the work area and
+// compares the resulting belt lengths in steps.
+Movement::KinAccuracy Movement::runKinematicsAccuracy(int gridN) {
+    KinAccuracy res;
+    res.singlePrecision = sizeof(KinScalar) == sizeof(float);
+    if (topDistance <= 0 || moving) return res;
+    if (gridN < 2) gridN = 2;
+    if (gridN > 64) gridN = 64;
+
+    const kin::Geometry<double> gd = makeGeometry<double>();
+    const kin::Geometry<float> gf = makeGeometry<float>();
+    const double tolerance = plannerCfg.ikToleranceDeg * PI / 180.0;
+
+    double xs[64], ys[64];
+    double ld[64], rd[64], lf[64], rf[64];
+    uint32_t usDouble = 0, usFloat = 0;
+    double sumErr = 0.0;
+
+    for (int iy = 0; iy < gridN; iy++) {
+        for (int ix = 0; ix < gridN; ix++) {
+            xs[ix] = width * ix / (gridN - 1);
+            ys[ix] = (double)topDistance * iy / (gridN - 1);
+        }
+
+        usDouble += timeKernelRow<double>(gd, xs, ys, gridN, tolerance, ld, rd);
+        usFloat += timeKernelRow<float>(gf, xs, ys, gridN, (float)tolerance, lf, rf);
+
+        for (int ix = 0; ix < gridN; ix++) {
+            const double err = std::max(fabs(ld[ix] - lf[ix]), fabs(rd[ix] - rf[ix])) * stepsPerMM;
+            if (err > res.maxStepError) res.maxStepError = err;
+            sumErr += err;
+            if (mmToSteps(ld[ix]) != mmToSteps(lf[ix]) || mmToSteps(rd[ix]) != mmToSteps(rf[ix])) res.stepMismatches++;
+        }
+    }
+
+    res.points = gridN * gridN;
+    res.meanStepError = sumErr / res.points;
+    res.doubleCallsPerSec = usDouble ? res.points * 1e6 / usDouble : 0.0;
+    res.floatCallsPerSec = usFloat ? res.points * 1e6 / usFloat : 0.0;
+    return res;
+}
+
 double Movement::computeCornerFactor(double dx, double dy) const {
     const double len = sqrt(dx * dx + dy * dy);
     const double prevLen = sqrt(lastSegmentDX * lastSegmentDX + lastSegmentDY * lastSegmentDY);
@@ -303,9 +718,7 @@ double Movement::computeCornerFactor(double dx, double dy) const {
     return f;
 }
 
-float Movement::beginLinearTravel(double x, double y, int speed) {
-    if (topDistance == -1 || !homed) throw std::invalid_argument("not ready");
-
+void Movement::planSegment(double x, double y, double speed, long fromLeft, long fromRight, bool travel, SegmentPlan& plan) {
     if (speed <= 0) speed = 1;
 
     double tx = x - tcpOffsetXmm;
@@ -339,26 +752,41 @@ float Movement::beginLinearTravel(double x, double y, int speed) {
     if (ty < 0.0) ty = 0.0;
 
     const auto lengths = getBeltLengths(tx, ty);
-    const int leftLegSteps = lengths.left;
-    const int rightLegSteps = lengths.right;
 
-    const int deltaLeft = abs((int)leftMotor->currentPosition() - leftLegSteps);
-    const int deltaRight = abs((int)rightMotor->currentPosition() - rightLegSteps);
+    plan.tx = tx;
+    plan.ty = ty;
+    plan.dx = dx;
+    plan.dy = dy;
+    plan.dirX = dirX;
+    plan.dirY = dirY;
+    plan.leftSteps = lengths.left;
+    plan.rightSteps = lengths.right;
+    plan.stepsLeft = lengths.left - (int)fromLeft;
+    plan.stepsRight = lengths.right - (int)fromRight;
+    plan.deltaLeft = abs(plan.stepsLeft);
+    plan.deltaRight = abs(plan.stepsRight);
+    plan.maxDelta = (plan.deltaLeft >= plan.deltaRight) ? plan.deltaLeft : plan.deltaRight;
+    plan.targetSpeed = 1.0;
+    plan.accel = 1.0;
+    plan.decel = 1.0;
+    if (plan.maxDelta == 0) return;
 
-    const int maxDelta = (deltaLeft >= deltaRight) ? deltaLeft : deltaRight;
-    if (maxDelta == 0) {
-        moving = false;
-        X = tx; Y = ty;
-        return 0.0f;
+    const double segLen = sqrt(dx * dx + dy * dy);
+
+    // Feed mode: speed is mm/s on the wall. Steps of the dominant motor per mm
+    // along this segment (the local Jacobian in the direction of travel).
+    if (plannerCfg.feedMode) {
+        const double stepsPerPathMM = (segLen > 1e-6) ? (double)plan.maxDelta / segLen : stepsPerMM;
+        speed *= stepsPerPathMM;
     }
 
-    // Dynamic feed from geometry/cornering
-    double cornerFactor = computeCornerFactor(dx, dy);
+    // Dynamic feed from geometry/cornering (travel moves start from rest, full speed;
+    // the time-optimal profile limits junctions in motor space instead)
+    double cornerFactor = (travel || plannerCfg.timeOptimal) ? 1.0 : computeCornerFactor(dx, dy);
     double targetSpeed = speed * cornerFactor;
 
     // Micro-segment limiter: tiny segments get slower automatically.
-    const double segLen = sqrt(dx * dx + dy * dy);
-    if (plannerCfg.microSlowLenMM > 0.0 && segLen > 1e-9 && segLen < plannerCfg.microSlowLenMM) {
+    if (!travel && !plannerCfg.curvatureSpeed && plannerCfg.microSlowLenMM > 0.0 && segLen > 1e-9 && segLen < plannerCfg.microSlowLenMM) {
         const double t = std::max(0.0, std::min(1.0, segLen / plannerCfg.microSlowLenMM));
         const double f = plannerCfg.microMinFactor + (1.0 - plannerCfg.microMinFactor) * t;
         targetSpeed *= std::max(0.05, std::min(1.0, f));
@@ -367,22 +795,79 @@ float Movement::beginLinearTravel(double x, double y, int speed) {
     // minimum segment-time clamp
     if (plannerCfg.minSegmentTimeMs > 0) {
         const double minTimeS = (double)plannerCfg.minSegmentTimeMs / 1000.0;
-        const double maxAllowedByTime = (double)maxDelta / minTimeS;
+        const double maxAllowedByTime = (double)plan.maxDelta / minTimeS;
         if (targetSpeed > maxAllowedByTime) targetSpeed = maxAllowedByTime;
     }
 
+    // per-motor ceiling; the dominant motor has the highest rate
+    if (plannerCfg.feedMode && targetSpeed > plannerCfg.maxStepRate) targetSpeed = plannerCfg.maxStepRate;
+
     if (targetSpeed < 1.0) targetSpeed = 1.0;
 
-    // Approximate S-curve by lowering accel around corners
+    // Approximate S-curve by lowering accel around corners (the stream has a real one)
     double accelScale = 1.0 - ((1.0 - cornerFactor) * plannerCfg.sCurveFactor);
     if (accelScale < 0.2) accelScale = 0.2;
-    const float localAccel = (float)std::max(1.0, (double)accelerationSteps * accelScale);
-leftMotor->setAcceleration(localAccel);
-    rightMotor->setAcceleration(localAccel);
+    if (plannerCfg.maxJerk > 0.0 && isStreaming()) accelScale = 1.0;
+
+    plan.targetSpeed = targetSpeed;
+    plan.accel = std::max(1.0, (double)accelerationSteps * accelScale);
+    plan.decel = plan.accel;
+
+    if (plannerCfg.dynamicAccel && segLen > 1e-6) {
+        const double stepsPerPathMM = (double)plan.maxDelta / segLen;
+        double accelMm = plan.accel / stepsPerPathMM;
+        double decelMm = accelMm;
+        dynamicAccelCarriage(X, Y, tx, ty, accelMm, decelMm);
+        plan.accel = std::max(1.0, accelMm * stepsPerPathMM);
+        plan.decel = std::max(1.0, decelMm * stepsPerPathMM);
+    }
+}
+
+void Movement::commitSegment(const SegmentPlan& plan) {
+    X = plan.tx;
+    Y = plan.ty;
+    lastSegmentDX = plan.dx;
+    lastSegmentDY = plan.dy;
+    lastBeltDL = plan.stepsLeft;
+    lastBeltDR = plan.stepsRight;
+    lastDirX = plan.dirX;
+    lastDirY = plan.dirY;
+}
+
+float Movement::beginLinearTravel(double x, double y, double speed) {
+    return startSegment(x, y, speed, false);
+}
+
+float Movement::beginBeltTravel(double x, double y, double speed) {
+    return startSegment(x, y, speed, true);
+}
+
+float Movement::startSegment(double x, double y, double speed, bool travel) {
+    if (topDistance == -1 || !homed) throw std::invalid_argument("not ready");
+
+    SegmentPlan plan;
+    planSegment(x, y, speed, leftMotor->currentPosition(), rightMotor->currentPosition(), travel, plan);
 
-    const float moveTime = (float)maxDelta / (float)targetSpeed;
-    float leftSpeed = (deltaLeft > 0) ? ((float)deltaLeft / moveTime) : 0.0f;
-    float rightSpeed = (deltaRight > 0) ? ((float)deltaRight / moveTime) : 0.0f;
+    if (plan.maxDelta == 0) {
+        moving = false;
+        X = plan.tx; Y = plan.ty;
+        return 0.0f;
+    }
+
+    // Speed and acceleration both scale with each motor's share of the move, so
+    // the two ramps are time-scaled copies and the belts stay in ratio (straight
+    // in belt space) while accelerating, not only at cruise.
+    const float leftShare = (float)plan.deltaLeft / (float)plan.maxDelta;
+    const float rightShare = (float)plan.deltaRight / (float)plan.maxDelta;
+
+    // one ramp per motor: the gentler of the two limits
+    const float localAccel = (float)std::min(plan.accel, plan.decel);
+    if (plan.deltaLeft > 0) leftMotor->setAcceleration(std::max(1.0f, localAccel * leftShare));
+    if (plan.deltaRight > 0) rightMotor->setAcceleration(std::max(1.0f, localAccel * rightShare));
+
+    const float moveTime = (float)plan.maxDelta / (float)plan.targetSpeed;
+    float leftSpeed = (plan.deltaLeft > 0) ? ((float)plan.targetSpeed * leftShare) : 0.0f;
+    float rightSpeed = (plan.deltaRight > 0) ? ((float)plan.targetSpeed * rightShare) : 0.0f;
     if (leftSpeed > 0.0f && leftSpeed < 1.0f) leftSpeed = 1.0f;
     if (rightSpeed > 0.0f && rightSpeed < 1.0f) rightSpeed = 1.0f;
 
@@ -390,23 +875,262 @@ leftMotor->setAcceleration(localAccel);
     rightMotor->enableOutputs();
 
     leftMotor->setMaxSpeed(leftSpeed);
-    leftMotor->moveTo(leftLegSteps);
+    leftMotor->moveTo(plan.leftSteps);
 
     rightMotor->setMaxSpeed(rightSpeed);
-    rightMotor->moveTo(rightLegSteps);
+    rightMotor->moveTo(plan.rightSteps);
+
+    commitSegment(plan);
+
+    moving = true;
+    return moveTime;
+}
+
+// A belt-space move interpolates both belt lengths linearly, so the carriage
+// follows a curve between the endpoints. Sample it with forward kinematics and
+// check that it stays inside the work area.
+bool Movement::isBeltPathSafe(Point fromPenTip, Point toPenTip) {
+    constexpr double MARGIN_MM = 0.5;
+    constexpr double SAMPLE_BELT_MM = 20.0;
+
+    if (topDistance <= 0) return false;
+
+    const double fx = fromPenTip.x - tcpOffsetXmm, fy = fromPenTip.y - tcpOffsetYmm;
+    const double tx = toPenTip.x - tcpOffsetXmm, ty = toPenTip.y - tcpOffsetYmm;
+    if (fx < -MARGIN_MM || fx > width + MARGIN_MM || fy < -MARGIN_MM) return false;
+    if (tx < -MARGIN_MM || tx > width + MARGIN_MM || ty < -MARGIN_MM) return false;
+
+    const Lengths a = getBeltLengths(std::max(0.0, std::min(width, fx)), std::max(0.0, fy));
+    KinScalar gamma = (KinScalar)gamma_last_position;
+    const Lengths b = getBeltLengths(std::max(0.0, std::min(width, tx)), std::max(0.0, ty));
+
+    const double l0 = stepsToMM(a.left), r0 = stepsToMM(a.right);
+    const double l1 = stepsToMM(b.left), r1 = stepsToMM(b.right);
+    const double beltMM = std::max(fabs(l1 - l0), fabs(r1 - r0));
+
+    int samples = (int)ceil(beltMM / SAMPLE_BELT_MM);
+    if (samples < 4) samples = 4;
+    if (samples > 32) samples = 32;
+
+    const KinScalar tiltTolerance = (KinScalar)(plannerCfg.ikToleranceDeg * PI / 180.0);
+    KinScalar px = (KinScalar)(fx + minSafeXOffset);
+    KinScalar py = (KinScalar)(fy + minSafeY);
+
+    for (int i = 1; i < samples; i++) {
+        const double t = (double)i / samples;
+        const KinScalar l = (KinScalar)(l0 + (l1 - l0) * t);
+        const KinScalar r = (KinScalar)(r0 + (r1 - r0) * t);
+        if (!kin::forwardKinematics<KinScalar>(kinGeometry, l, r, (KinScalar)0.01, tiltTolerance, px, py, gamma)) return false;
+
+        const double cx = px - minSafeXOffset;
+        const double cy = py - minSafeY;
+        if (cx < -MARGIN_MM || cx > width + MARGIN_MM || cy < -MARGIN_MM) return false;
+    }
+    return true;
+}
+
+// A segment is executed with both belts interpolated linearly. Distance between
+// the XY midpoint of the chord and where the carriage actually is at half the
+// belt travel; close to the maximum deviation of the segment.
+double Movement::beltChordDeviationMM(Point aPenTip, Point bPenTip) {
+    if (topDistance <= 0) return 0.0;
+
+    auto clampX = [&](double x) { return std::max(0.0, std::min(width, x)); };
+    auto clampY = [&](double y) { return std::max(0.0, y); };
+
+    const double ax = clampX(aPenTip.x - tcpOffsetXmm), ay = clampY(aPenTip.y - tcpOffsetYmm);
+    const double bx = clampX(bPenTip.x - tcpOffsetXmm), by = clampY(bPenTip.y - tcpOffsetYmm);
+    const double mx = 0.5 * (ax + bx), my = 0.5 * (ay + by);
+
+    double la, ra, lb, rb, gamma;
+    if (!lookupBeltLegs(ax, ay, la, ra)) solveBeltLegs(ax, ay, la, ra, gamma);
+    if (!lookupBeltLegs(bx, by, lb, rb)) solveBeltLegs(bx, by, lb, rb, gamma);
+
+    KinScalar fx = (KinScalar)(mx + minSafeXOffset);
+    KinScalar fy = (KinScalar)(my + minSafeY);
+    KinScalar g = (KinScalar)gamma_last_position;
+    const KinScalar tiltTolerance = (KinScalar)(plannerCfg.ikToleranceDeg * PI / 180.0);
+    if (!kin::forwardKinematics<KinScalar>(kinGeometry, (KinScalar)(0.5 * (la + lb)), (KinScalar)(0.5 * (ra + rb)),
+                                           (KinScalar)0.001, tiltTolerance, fx, fy, g)) {
+        return 1e9;  // unknown: subdivide
+    }
+
+    return kin::length<double>(fx - minSafeXOffset - mx, fy - minSafeY - my);
+}
+
+bool Movement::isStreaming() const {
+    return plannerCfg.streamMotion && stream && stream->isSupported();
+}
+
+bool Movement::canQueueSegment() const {
+    // Pause only stops new tasks, what is queued still runs: keep that short.
+    // One block is always admitted, however long.
+    constexpr double STREAM_MAX_QUEUED_S = 0.5;
+    if (!stream || stream->isFull()) return false;
+    return stream->isEmpty() || stream->queuedSeconds() < STREAM_MAX_QUEUED_S;
+}
+
+float Movement::queueLinearSegment(double x, double y, double speed, double entryCapMmS) {
+    return queueSegment(x, y, speed, entryCapMmS, false);
+}
+
+float Movement::queueBeltTravel(double x, double y, double speed, double entryCapMmS) {
+    return queueSegment(x, y, speed, entryCapMmS, true);
+}
+
+float Movement::queueSegment(double x, double y, double speed, double entryCapMmS, bool travel) {
+    if (topDistance == -1 || !homed) throw std::invalid_argument("not ready");
+    if (!canQueueSegment()) throw std::invalid_argument("stream full");
+
+    const double prevDX = lastSegmentDX;
+    const double prevDY = lastSegmentDY;
+    const int prevDL = lastBeltDL;
+    const int prevDR = lastBeltDR;
+
+    SegmentPlan plan;
+    planSegment(x, y, speed, lround(stream->tailLeft()), lround(stream->tailRight()), travel, plan);
+
+    if (plan.maxDelta == 0) {
+        X = plan.tx; Y = plan.ty;
+        return 0.0f;
+    }
+
+    // Convert the dominant-motor step rate/accel into path units for the stream.
+    double lenMM = sqrt(plan.dx * plan.dx + plan.dy * plan.dy);
+    if (lenMM < 1e-6) lenMM = stepsToMM(plan.maxDelta);
+    const double mmPerStep = lenMM / (double)plan.maxDelta;
+
+    StepStream::Block b;
+    b.endL = plan.leftSteps;
+    b.endR = plan.rightSteps;
+    b.lenMM = lenMM;
+    b.vNom = plan.targetSpeed * mmPerStep;
+    b.accel = plan.accel * mmPerStep;
+    b.decel = plan.decel * mmPerStep;
+    b.vJunction = b.vNom;
+    b.shaperHz = plannerCfg.shaperAuto ? swingFrequencyHz(plan.tx, plan.ty) : 0.0;
+
+    const double prevLen = sqrt(prevDX * prevDX + prevDY * prevDY);
+    if (plannerCfg.timeOptimal) {
+        b.vJunction = std::min(b.vJunction, (double)beltJunctionSpeedMmS(prevDL, prevDR, plan.stepsLeft, plan.stepsRight, lenMM,
+                                                                         plan.accel, plannerCfg.junctionDeviationMM));
+    } else if (prevLen > 1e-9 && lenMM > 1e-9) {
+        double dot = (plan.dx * prevDX + plan.dy * prevDY) / (lenMM * prevLen);
+        dot = std::max(-1.0, std::min(1.0, dot));
+        b.vJunction = std::min(b.vJunction, (double)junctionSpeedMmS(acos(dot), b.accel, plannerCfg.junctionDeviationMM));
+    }
+    if (entryCapMmS >= 0.0) b.vJunction = std::min(b.vJunction, entryCapMmS);
+
+    leftMotor->enableOutputs();
+    rightMotor->enableOutputs();
+
+    stream->push(b);
+    commitSegment(plan);
+
+    moving = true;
+    return (float)plan.maxDelta / (float)plan.targetSpeed;
+}
+
+float Movement::queueBeltBlock(double x, double y, long leftSteps, long rightSteps, double vNomMmS, double vJunctionMmS) {
+    if (topDistance == -1 || !homed) throw std::invalid_argument("not ready");
+    if (!canQueueSegment()) throw std::invalid_argument("stream full");
+
+    const double tx = x - tcpOffsetXmm;
+    const double ty = y - tcpOffsetYmm;
+    const double dx = tx - X;
+    const double dy = ty - Y;
+
+    const int stepsLeft = (int)(leftSteps - lround(stream->tailLeft()));
+    const int stepsRight = (int)(rightSteps - lround(stream->tailRight()));
+    const int maxDelta = std::max(abs(stepsLeft), abs(stepsRight));
+    if (maxDelta == 0) {
+        X = tx; Y = ty;
+        return 0.0f;
+    }
+
+    double lenMM = sqrt(dx * dx + dy * dy);
+    if (lenMM < 1e-6) lenMM = stepsToMM(maxDelta);
+    const double mmPerPathStep = lenMM / (double)maxDelta;
+
+    // the file was planned for this machine; only the motor limits are applied
+    // (maxStepRate caps the dominant motor in feed mode, as in planSegment())
+    if (vNomMmS <= 0.0) vNomMmS = motorStepsPerSec(moveSpeedSteps) * mmPerPathStep;
+    if (plannerCfg.feedMode) vNomMmS = std::min(vNomMmS, (double)plannerCfg.maxStepRate * mmPerPathStep);
+    vNomMmS = std::max(vNomMmS, mmPerPathStep);
+
+    StepStream::Block b;
+    b.endL = leftSteps;
+    b.endR = rightSteps;
+    b.lenMM = lenMM;
+    b.vNom = vNomMmS;
+    b.accel = std::max(1.0, (double)accelerationSteps) * mmPerPathStep;
+    b.decel = b.accel;
+    b.vJunction = std::max(0.0, std::min(vNomMmS, vJunctionMmS));
+    b.shaperHz = plannerCfg.shaperAuto ? swingFrequencyHz(std::max(0.0, std::min(width, tx)), std::max(0.0, ty)) : 0.0;
+
+    leftMotor->enableOutputs();
+    rightMotor->enableOutputs();
+
+    stream->push(b);
 
     X = tx;
     Y = ty;
     lastSegmentDX = dx;
     lastSegmentDY = dy;
-    lastDirX = dirX;
-    lastDirY = dirY;
+    lastBeltDL = stepsLeft;
+    lastBeltDR = stepsRight;
+    lastDirX = (dx > 1e-6) ? 1 : ((dx < -1e-6) ? -1 : 0);
+    lastDirY = (dy > 1e-6) ? 1 : ((dy < -1e-6) ? -1 : 0);
 
     moving = true;
-    return moveTime;
+    return (float)(lenMM / vNomMmS);
+}
+
+cmdbin::Machine Movement::machine() const {
+    return cmdbin::makeMachine(topDistance, tcpOffsetXmm, tcpOffsetYmm, stepsPerRotation, travelPerRotationMM(), d_t,
+                               d_p, d_m, midPulleyToWall, mass_bot, g_constant, safeXFraction, safeYFraction,
+                               belt_elongation_coefficient, sizeof(KinScalar) == sizeof(float));
+}
+
+uint32_t Movement::getStreamUnderruns() const { return stream ? stream->getUnderruns() : 0; }
+uint32_t Movement::getStreamErrors() const { return stream ? stream->getBackendErrors() : 0; }
+double Movement::getShaperHz() const { return stream ? stream->getShaperHz() : 0.0; }
+
+KinScalar Movement::junctionSpeedMmS(KinScalar turnRad, KinScalar accelMmS2, KinScalar junctionDeviationMm) {
+    return kin::junctionSpeed<KinScalar>(std::cos(turnRad), accelMmS2, junctionDeviationMm);
+}
+
+KinScalar Movement::beltJunctionSpeedMmS(KinScalar prevDL, KinScalar prevDR, KinScalar dL, KinScalar dR, KinScalar lenMM,
+                                         KinScalar accelSteps, KinScalar junctionDeviationMm) {
+    const KinScalar unlimited = (KinScalar)1e9;
+    const KinScalar n0 = kin::length(prevDL, prevDR);
+    const KinScalar n1 = kin::length(dL, dR);
+    if (n0 < (KinScalar)1e-9 || n1 < (KinScalar)1e-9 || lenMM < (KinScalar)1e-9) return unlimited;
+
+    const KinScalar cosTurn = (prevDL * dL + prevDR * dR) / (n0 * n1);
+    const KinScalar vSteps = kin::junctionSpeed<KinScalar>(cosTurn, accelSteps, junctionDeviationMm * (KinScalar)stepsPerMM);
+    if (vSteps >= unlimited) return unlimited;
+
+    // steps/s along the belt step vector -> mm/s along the path
+    return vSteps * lenMM / n1;
 }
 
 int Movement::estimateMaxDeltaSteps(double x, double y, int* outDeltaLeft, int* outDeltaRight) {
+    int leftLegSteps = 0;
+    int rightLegSteps = 0;
+    estimateBeltSteps(x, y, leftLegSteps, rightLegSteps);
+
+    // Measure from the end of already streamed motion (== current position when idle).
+    const int dL = abs((int)lround(stream->tailLeft()) - leftLegSteps);
+    const int dR = abs((int)lround(stream->tailRight()) - rightLegSteps);
+
+    if (outDeltaLeft) *outDeltaLeft = dL;
+    if (outDeltaRight) *outDeltaRight = dR;
+
+    return (dL >= dR) ? dL : dR;
+}
+
+void Movement::estimateBeltSteps(double x, double y, int& outLeft, int& outRight) {
     if (topDistance == -1 || !homed) throw std::invalid_argument("not ready");
 
     // Keep planner estimates consistent and non-fatal: clamp instead of throwing.
@@ -417,18 +1141,9 @@ int Movement::estimateMaxDeltaSteps(double x, double y, int* outDeltaLeft, int*
     const double tx = std::max(0.0, std::min(width, cx));
     const double ty = (cy < 0.0) ? 0.0 : cy;
 
-
     const auto lengths = getBeltLengths(tx, ty);
-    const int leftLegSteps = lengths.left;
-    const int rightLegSteps = lengths.right;
-
-    const int dL = abs((int)leftMotor->currentPosition() - leftLegSteps);
-    const int dR = abs((int)rightMotor->currentPosition() - rightLegSteps);
-
-    if (outDeltaLeft) *outDeltaLeft = dL;
-    if (outDeltaRight) *outDeltaRight = dR;
-
-    return (dL >= dR) ? dL : dR;
+    outLeft = lengths.left;
+    outRight = lengths.right;
 }
 
 double Movement::getWidth() {
@@ -443,12 +1158,127 @@ Movement::Point Movement::getCoordinates() {
     return Point(X + tcpOffsetXmm, Y + tcpOffsetYmm);
 }
 
-Movement::Point Movement::getCoordinatesLive() {
+Movement::Point Movement::getCommandedCoordinates() {
     if (X == -1 || Y == -1) return Point(0, 0);
     // Report pen-tip coordinates
     return Point(X + tcpOffsetXmm, Y + tcpOffsetYmm);
 }
 
+Movement::Point Movement::getCoordinatesLive() {
+    if (X == -1 || Y == -1) return Point(0, 0);
+
+    portENTER_CRITICAL(&liveMux);
+    const LiveSample s = live;
+    portEXIT_CRITICAL(&liveMux);
+
+    if (!moving || !s.valid) return getCommandedCoordinates();
+    return Point(s.x, s.y);
+}
+
+// Runs the FK for the web task at a fixed rate while moving; getCoordinatesLive()
+// and getMeasuredSpeedMmS() only copy the sample.
+void Movement::publishLiveSample(bool movingNow) {
+    constexpr uint32_t LIVE_SAMPLE_US = 20000;
+
+    LiveSample s;
+    if (movingNow) {
+        const uint32_t now = micros();
+        if ((now - liveSampleUs) < LIVE_SAMPLE_US) return;
+        liveSampleUs = now;
+
+        Point p;
+        s.valid = getMeasuredCoordinates(p);
+        if (s.valid) {
+            s.x = p.x;
+            s.y = p.y;
+            s.speedMmS = measuredSpeedMmS;
+        }
+    } else {
+        if (!live.valid && live.speedMmS == 0.0) return;
+        measuredSpeedMmS = 0.0;
+    }
+
+    portENTER_CRITICAL(&liveMux);
+    live = s;
+    portEXIT_CRITICAL(&liveMux);
+}
+
+// Forward kinematics from the step counters (kin::forwardKinematics), warm
+// started from the previous result. Also updates the measured speed.
+bool Movement::getMeasuredCoordinates(Point& out) {
+    constexpr double FK_TOLERANCE_MM = 0.001;
+    constexpr uint32_t SPEED_SAMPLE_US = 50000;
+
+    if (topDistance <= 0 || X == -1 || Y == -1) return false;
+
+    const long posL = leftMotor->currentPosition();
+    const long posR = rightMotor->currentPosition();
+
+    if (fk.valid && posL == fk.posL && posR == fk.posR) {
+        out = Point(fk.frameX - minSafeXOffset + tcpOffsetXmm, fk.frameY - minSafeY + tcpOffsetYmm);
+        return true;
+    }
+
+    KinScalar fx, fy, gamma;
+    if (fk.valid) {
+        fx = (KinScalar)fk.frameX;
+        fy = (KinScalar)fk.frameY;
+        gamma = (KinScalar)fk.gamma;
+    } else {
+        fx = (KinScalar)(X + minSafeXOffset);
+        fy = (KinScalar)(Y + minSafeY);
+        gamma = (KinScalar)gamma_last_position;
+    }
+
+    double leftLeg = stepsToMM((int)posL);
+    double rightLeg = stepsToMM((int)posR);
+    if (belt_elongation_coefficient != 0.0) {
+        // undo getDilationCorrectedBeltLength() with the forces at the warm start
+        KinScalar g = gamma, F_L, F_R;
+        if (kin::solveTiltNewton<KinScalar>(kinGeometry, fx, fy, (KinScalar)1e-4, g, F_L, F_R)) {
+            leftLeg *= 1.0 + belt_elongation_coefficient * F_L;
+            rightLeg *= 1.0 + belt_elongation_coefficient * F_R;
+        }
+    }
+
+    const KinScalar tiltTolerance = (KinScalar)(plannerCfg.ikToleranceDeg * PI / 180.0);
+    if (!kin::forwardKinematics<KinScalar>(kinGeometry, (KinScalar)leftLeg, (KinScalar)rightLeg,
+                                           (KinScalar)FK_TOLERANCE_MM, tiltTolerance, fx, fy, gamma)) {
+        fk.valid = false;
+        return false;
+    }
+
+    fk.valid = true;
+    fk.posL = posL;
+    fk.posR = posR;
+    fk.frameX = fx;
+    fk.frameY = fy;
+    fk.gamma = gamma;
+
+    const uint32_t now = micros();
+    const uint32_t dt = now - fk.sampleUs;
+    if (!fk.hasSample || dt >= SPEED_SAMPLE_US) {
+        if (fk.hasSample) {
+            const double d = kin::length(fk.frameX - fk.sampleX, fk.frameY - fk.sampleY);
+            measuredSpeedMmS = d * 1e6 / dt;
+        }
+        fk.hasSample = true;
+        fk.sampleUs = now;
+        fk.sampleX = fk.frameX;
+        fk.sampleY = fk.frameY;
+    }
+
+    out = Point(fk.frameX - minSafeXOffset + tcpOffsetXmm, fk.frameY - minSafeY + tcpOffsetYmm);
+    return true;
+}
+
+double Movement::getMeasuredSpeedMmS() const {
+    portENTER_CRITICAL(&liveMux);
+    const double v = live.speedMmS;
+    portEXIT_CRITICAL(&liveMux);
+    return moving ? v : 0.0;
+}
+
 void Movement::setTcpOffset(double tcpXmm, double tcpYmm) {
     // Keep sane bounds (prevent ridiculous values)
     if (!isfinite(tcpXmm)) tcpXmm = 0.0;
@@ -467,14 +1297,20 @@ void Movement::getTcpOffset(double& outTcpXmm, double& outTcpYmm) const {
     outTcpYmm = tcpOffsetYmm;
 }
 
+// Speed setting -> single motor steps/s (belt speed in feed mode).
+double Movement::motorStepsPerSec(double speed) const {
+    if (!plannerCfg.feedMode) return speed;
+    return std::min(speed * stepsPerMM, (double)plannerCfg.maxStepRate);
+}
+
 void Movement::setSpeeds(int newPrintSpeed, int newMoveSpeed) {
     if (newPrintSpeed <= 0 || newMoveSpeed <= 0) return;
 
     printSpeedSteps = newPrintSpeed;
     moveSpeedSteps = newMoveSpeed;
 
-    if (leftMotor) leftMotor->setMaxSpeed(moveSpeedSteps);
-    if (rightMotor) rightMotor->setMaxSpeed(moveSpeedSteps);
+    if (leftMotor) leftMotor->setMaxSpeed(motorStepsPerSec(moveSpeedSteps));
+    if (rightMotor) rightMotor->setMaxSpeed(motorStepsPerSec(moveSpeedSteps));
 
     Serial.printf("setSpeeds: print=%d, move=%d\n", printSpeedSteps, moveSpeedSteps);
 }
@@ -485,10 +1321,10 @@ void Movement::extend1000mm() {
     rightMotor->enableOutputs();
 
     leftMotor->move(steps);
-    leftMotor->setSpeed(moveSpeedSteps);
+    leftMotor->setSpeed(motorStepsPerSec(moveSpeedSteps));
 
     rightMotor->move(steps);
-    rightMotor->setSpeed(moveSpeedSteps);
+    rightMotor->setSpeed(motorStepsPerSec(moveSpeedSteps));
 
     moving = true;
 }
@@ -499,6 +1335,12 @@ void Movement::disableMotors() {
 }
 
 bool Movement::isMoving() { return moving; }
+
+void Movement::abortMotion() {
+    if (!moving || streamAborted) return;
+    if (stream && stream->isActive() && stream->abort()) streamAborted = true;
+}
+
 bool Movement::hasStartedHoming() { return startedHoming; }
 int Movement::getTopDistance() { return topDistance; }
 
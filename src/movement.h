@@ -3,6 +3,9 @@
 
 #include <Arduino.h>
 #include "stepper_backend.h"
+#include "step_stream.h"
+#include "ik_table.h"
+#include "kinematics.h"
 #include <cmath>
 #include "display.h"
 
@@ -18,11 +21,24 @@ constexpr double LEGACY_DIAMETER_MM = 12.69;
 
 constexpr int stepsPerRotation = 200 * 64;
 
-static inline double travelPerRotationMM() { return USE_GT2_PULLEY ? (GT2_TEETH * GT2_PITCH_MM) : (LEGACY_DIAMETER_MM * PI); }
+static constexpr double travelPerRotationMM() { return USE_GT2_PULLEY ? (GT2_TEETH * GT2_PITCH_MM) : (LEGACY_DIAMETER_MM * PI); }
 
-static inline int mmToSteps(double mm) { return int((mm / travelPerRotationMM()) * stepsPerRotation); }
+constexpr double stepsPerMM = stepsPerRotation / travelPerRotationMM();
+constexpr double mmPerStep = travelPerRotationMM() / stepsPerRotation;
 
-static inline double stepsToMM(int steps) { return (double(steps) / double(stepsPerRotation)) * travelPerRotationMM(); }
+static inline int mmToSteps(double mm) { return int(mm * stepsPerMM); }
+
+static inline double stepsToMM(int steps) { return double(steps) * mmPerStep; }
+
+// Scalar type of the kinematics kernel (kinematics.h) and of the lookahead
+// planner's speed math. Build with -DVPLOTTER_KIN_FLOAT to run both in single
+// precision on the ESP32 FPU; /diag/kinAccuracy reports the IK step error
+// against double.
+#ifdef VPLOTTER_KIN_FLOAT
+typedef float KinScalar;
+#else
+typedef double KinScalar;
+#endif
 
 constexpr double midPulleyToWall = 41.0;
 constexpr float homedStepOffsetMM = 20.0;
@@ -50,6 +66,8 @@ constexpr int LEFT_DIR_PIN = 33;
 constexpr int RIGHT_STEP_PIN = 27;
 constexpr int RIGHT_DIR_PIN = 25;
 
+namespace cmdbin { struct Machine; }
+
 
 
 
@@ -59,12 +77,16 @@ class Movement {
     struct PlannerConfig {
         double junctionDeviationMM;   
         int lookaheadSegments;       
+        // Keep at least this much planned motion queued, topped up every task
+        // (lookaheadSegments is then the minimum depth; 0 = fixed count).
+        double lookaheadSeconds;    // 0..10
         int minSegmentTimeMs;       
         double cornerSlowdown;       
         double minCornerFactor;      
 
         double minSegmentLenMM;     
-        double collinearDeg;        
+        double collinearDeg;        // superseded by simplifyToleranceMM, kept for saved settings
+        double simplifyToleranceMM; // 0..0.5, max deviation of dropped points (0 = keep all)
 
         // Micro-segment speed limiter (for tiny segments like mini circles)
         double microSlowLenMM;      // 0..20mm (0 disables)
@@ -75,19 +97,96 @@ class Movement {
 
         double sCurveFactor;
 
+        // Jerk limit of the streamed profile, mm/s^3 (0 = trapezoid). When set,
+        // streamed moves follow an S-curve and sCurveFactor is not applied.
+        double maxJerk;             // 0..1000000
+
+        // Input shaper on the streamed belt positions against carriage swing.
+        // shaperAuto follows the swing frequency of the belt/force model
+        // across the wall instead of the fixed shaperFreqHz.
+        int shaperType;             // 0 off, 1 ZV, 2 ZVD, 3 EI
+        double shaperFreqHz;        // 0.5..50
+        bool shaperAuto;
+
+        // Time-optimal profile: junction speeds from the belt direction change
+        // and the motor acceleration instead of the XY corner heuristics
+        // (cornerSlowdown, XY junction deviation).
+        bool timeOptimal;
+
+        // Cap speed through curves by v = sqrt(a * r), with r from the arc
+        // radius (G2/G3) or a circle through three queued points. Replaces the
+        // micro-segment limiter (microSlowLenMM) while on.
+        bool curvatureSpeed;
+
+        // Round drawing corners with a circular fillet that stays within
+        // cornerBlendMM of the vertex, so the carriage keeps speed (0 = sharp).
+        double cornerBlendMM;       // 0..2
+
+        // Acceleration from the mass/belt force model instead of one global
+        // number: gravityAccelGain adds acceleration going down and takes it
+        // away climbing (the reverse for braking), and the belt tensions must
+        // stay between beltMinForceN (slack) and beltMaxForceN while ramping.
+        bool dynamicAccel;
+        double gravityAccelGain;    // 0..0.9
+        double beltMinForceN;       // 0..50
+        double beltMaxForceN;       // beltMinForceN+1..200
+
+        // Stream segments into the stepper queues (no stop between segments).
+        bool streamMotion;
+
+        // Interpolated IK grid instead of the iterative solve (built after setTopDistance,
+        // used only if it stays within one step of the solve everywhere).
+        bool ikTable;
+
+        // Tilt solver: Newton on the torque balance (scan is the fallback).
+        bool ikNewton;
+        double ikToleranceDeg;      // 0.00001..0.2
+
+        // Pen-up travel as one move straight in belt space (if it stays in the work area).
+        bool beltSpaceTravel;
+
+        // Max XY deviation of a segment from the straight line (0 = fixed slicing by minSegmentLenMM).
+        double maxDeviationMM;      // 0..1
+
+        // Feed mode: print/move speeds are mm/s on the wall instead of steps/s
+        // of the dominant motor. maxStepRate caps each motor (steps/s).
+        bool feedMode;
+        int maxStepRate;            // 100..40000
+
         PlannerConfig() :
             junctionDeviationMM(0.02),
             lookaheadSegments(48),
+            lookaheadSeconds(2.0),
             minSegmentTimeMs(3),
             cornerSlowdown(0.55),
             minCornerFactor(0.30),
             minSegmentLenMM(0.20),
             collinearDeg(3.0),
+            simplifyToleranceMM(0.02),
             microSlowLenMM(0.0),
             microMinFactor(0.35),
             backlashXmm(0.0),
             backlashYmm(0.0),
-            sCurveFactor(0.35) {}
+            sCurveFactor(0.35),
+            maxJerk(0.0),
+            shaperType(0),
+            shaperFreqHz(1.0),
+            shaperAuto(false),
+            timeOptimal(false),
+            curvatureSpeed(false),
+            cornerBlendMM(0.0),
+            dynamicAccel(false),
+            gravityAccelGain(0.3),
+            beltMinForceN(2.0),
+            beltMaxForceN(40.0),
+            streamMotion(true),
+            ikTable(false),
+            ikNewton(true),
+            ikToleranceDeg(0.001),
+            beltSpaceTravel(true),
+            maxDeviationMM(0.05),
+            feedMode(false),
+            maxStepRate(4000) {}
     };
 
     void setPlannerConfig(const PlannerConfig& cfg);
@@ -119,14 +218,45 @@ class Movement {
         Point() : x(0), y(0) {}
     };
 
-    static double distanceBetweenPoints(Point p1, Point p2) { return sqrt(pow(p2.x - p1.x, 2) + pow(p2.y - p1.y, 2)); }
+    static double distanceBetweenPoints(Point p1, Point p2) { return kin::length(p2.x - p1.x, p2.y - p1.y); }
+
+    // GRBL-style junction deviation limit -> max junction speed in mm/s.
+    // turnRad: direction change between the segments (0 = straight, no limit;
+    // pi = reversal, 0 mm/s), see kin::junctionSpeed().
+    static KinScalar junctionSpeedMmS(KinScalar turnRad, KinScalar accelMmS2, KinScalar junctionDeviationMm);
+
+    // Same limit in motor space: junction deviation (converted to steps) on the
+    // belt step vectors of two blocks, with the motor acceleration. Returns the
+    // path speed in mm/s of the outgoing block (lenMM long).
+    static KinScalar beltJunctionSpeedMmS(KinScalar prevDL, KinScalar prevDR, KinScalar dL, KinScalar dR, KinScalar lenMM,
+                                          KinScalar accelSteps, KinScalar junctionDeviationMm);
+
+    // Acceleration/deceleration (mm/s^2, both passed in as the global value)
+    // for a straight move between two pen tip points, from the gravity
+    // direction and the belt tension limits. No-op unless dynamicAccel is set.
+    void dynamicAccelLimits(Point fromPenTip, Point toPenTip, double& accelMmS2, double& decelMmS2) const;
 
     bool isMoving();
+    // Brings a streamed motion to a controlled stop on the path (StepStream::
+    // abort); the position is re-read from the step counters once it is at
+    // rest. isMoving() stays true until then. A single blocking move finishes.
+    void abortMotion();
     bool hasStartedHoming();
     double getWidth();
 
+    // Pen-tip position: measured from the step counters (forward kinematics,
+    // sampled by runSteppers()) while moving, otherwise the commanded position.
+    // Safe from the web task: it only reads the published sample.
     Point getCoordinatesLive();
     Point getCoordinates();
+    // Last queued target (where the motion will end), pen-tip.
+    Point getCommandedCoordinates();
+    // Forward kinematics of the current step counters; false if not homed.
+    // Updates the FK cache: loop only.
+    bool getMeasuredCoordinates(Point& out);
+    // Carriage speed from successive measured positions (0 when idle), from
+    // the published sample like getCoordinatesLive().
+    double getMeasuredSpeedMmS() const;
 
     // TCP (Tool Center Point) offset in mm.
     // The firmware uses XY coordinates as "pen tip" coordinates.
@@ -145,13 +275,81 @@ class Movement {
     int extendToHome();
     void runSteppers();
 
-    float beginLinearTravel(double x, double y, int speed);
+    float beginLinearTravel(double x, double y, double speed);
+
+    // Streaming variant of beginLinearTravel(): appends the segment to the step
+    // stream and returns immediately, consecutive segments are blended.
+    bool isStreaming() const;
+    bool canQueueSegment() const;
+    // entryCapMmS >= 0 limits the junction speed into this segment (lookahead plan).
+    float queueLinearSegment(double x, double y, double speed, double entryCapMmS = -1.0);
+
+    // Pen-up travel: a single move with both belts interpolated linearly (the XY
+    // path bows), no corner/micro-segment slowdown. Check isBeltPathSafe() first.
+    float beginBeltTravel(double x, double y, double speed);
+    float queueBeltTravel(double x, double y, double speed, double entryCapMmS = -1.0);
+    bool isBeltPathSafe(Point fromPenTip, Point toPenTip);
+
+    // Block of a compiled job (command_format.h): belt targets and speeds were
+    // planned on a host, only the step stream runs here. x/y (pen tip) are for
+    // the reported position and the path length. vNomMmS <= 0 = move speed.
+    float queueBeltBlock(double x, double y, long leftSteps, long rightSteps, double vNomMmS, double vJunctionMmS);
+
+    // Parameters a compiled job depends on; it must match the file header.
+    cmdbin::Machine machine() const;
+
+    // XY deviation (mm) of a segment a->b executed with linear belt interpolation.
+    double beltChordDeviationMM(Point aPenTip, Point bPenTip);
+
+    uint32_t getStreamUnderruns() const;
+    uint32_t getStreamErrors() const;
+    double getShaperHz() const;   // frequency the shaper runs at (0 = off)
+
+    bool isIkTableReady() const;
+    // The table is (about to be) built row by row from runSteppers().
+    bool isIkTableBuilding() const { return ikTableDirty || ikBuildRow >= 0; }
+    double getIkTableMaxErrorMM() const { return ikTableMaxErrMM; }
+    size_t getIkTableBytes() const { return ikTable.bytes(); }
+    uint32_t getIkNewtonFallbacks() const { return ikNewtonFallbacks; }
+
+    struct IkBenchmark {
+        int calls = 0;
+        double scanCallsPerSec = 0.0;
+        double newtonCallsPerSec = 0.0;
+        double tableCallsPerSec = 0.0;   // 0 if the table is not ready
+        double maxGammaDiffDeg = 0.0;    // Newton vs scan
+        int newtonFallbacks = 0;
+    };
+
+    // Blocking microbenchmark of the IK solvers. Uses the solver state
+    // (gamma_last_position) the loop uses: only with the runner stopped, not
+    // moving and no IK table build running.
+    IkBenchmark runIkBenchmark(int calls);
+
+    struct KinAccuracy {
+        bool singlePrecision = false;    // KinScalar of this build
+        int points = 0;
+        double maxStepError = 0.0;       // float vs double belt length, steps
+        double meanStepError = 0.0;
+        int stepMismatches = 0;          // points where a belt target differs by >= 1 step
+        double doubleCallsPerSec = 0.0;
+        double floatCallsPerSec = 0.0;
+    };
+
+    // Compares the float and double kernels on a grid over the work area.
+    // Same preconditions as runIkBenchmark().
+    KinAccuracy runKinematicsAccuracy(int gridN);
 
     // Estimate step deltas for an XY target without starting a move.
     // Used by runner lookahead planner to map between XY mm/s and stepper steps/s.
     int estimateMaxDeltaSteps(double x, double y, int* outDeltaLeft = nullptr, int* outDeltaRight = nullptr);
 
+    // Belt targets (steps) for a pen-tip XY, clamped like a real move. No motion.
+    void estimateBeltSteps(double x, double y, int& outLeft, int& outRight);
+
     void setSpeeds(int newPrintSpeed, int newMoveSpeed);
+    bool isFeedMode() const { return plannerCfg.feedMode; }
+    double motorStepsPerSec(double speed) const;
 
     void extend1000mm();
     Point getHomeCoordinates();
@@ -195,13 +393,34 @@ class Movement {
     // for cornering/backlash
     double lastSegmentDX = 0.0;
     double lastSegmentDY = 0.0;
+    int lastBeltDL = 0;     // signed steps of the last segment
+    int lastBeltDR = 0;
     int lastDirX = 0;
     int lastDirY = 0;
 
     StepperBackend* leftMotor;
     StepperBackend* rightMotor;
+    StepStream* stream;
+    bool streamAborted = false;   // abortMotion() ran, resync X/Y at rest
     Display* display;
 
+    struct SegmentPlan {
+        double tx, ty;
+        double dx, dy;
+        int dirX, dirY;
+        int leftSteps, rightSteps;
+        int deltaLeft, deltaRight, maxDelta;
+        int stepsLeft, stepsRight;   // signed deltas
+        double targetSpeed;   // dominant motor, steps/s
+        double accel;         // dominant motor, steps/s^2
+        double decel;         // same, slowing down
+    };
+
+    void planSegment(double x, double y, double speed, long fromLeft, long fromRight, bool travel, SegmentPlan& plan);
+    void commitSegment(const SegmentPlan& plan);
+    float startSegment(double x, double y, double speed, bool travel);
+    float queueSegment(double x, double y, double speed, double entryCapMmS, bool travel);
+
     void setOrigin();
 
     long infiniteStepsSteps = 999999999L;
@@ -211,10 +430,75 @@ class Movement {
 
     double gamma_last_position = 0.0;
 
+    // IK table: residual of the exact solve against the tilt-free belt lengths.
+    // Rows are filled from runSteppers() while idle, lookups use it once complete.
+    IkTable ikTable;
+    volatile bool ikTableReady = false;
+    volatile bool ikTableDirty = false;
+    int ikBuildRow = -1;
+    double ikBuildGamma = 0.0;
+    double ikTableMaxErrMM = 0.0;
+
+    void serviceIkTable();
+    bool lookupBeltLegs(double x, double y, double& leftLeg, double& rightLeg);
+    void solveBeltLegs(double x, double y, double& leftLeg, double& rightLeg, double& gamma);
+    void solveTiltScan(double frameX, double frameY, double& gamma, double& F_L, double& F_R) const;
+    bool solveTiltNewton(double frameX, double frameY, double& gamma, double& F_L, double& F_R) const;
+    uint32_t ikNewtonFallbacks = 0;
+    void flatBeltLegs(double x, double y, double& leftLeg, double& rightLeg) const;
+
+    kin::Geometry<KinScalar> kinGeometry{};
+
+    // forward kinematics cache (frame coordinates) and speed sampling
+    struct ForwardState {
+        bool valid = false;
+        long posL = 0;
+        long posR = 0;
+        double frameX = 0.0;
+        double frameY = 0.0;
+        double gamma = 0.0;
+
+        bool hasSample = false;
+        uint32_t sampleUs = 0;
+        double sampleX = 0.0;
+        double sampleY = 0.0;
+    };
+    ForwardState fk;
+    double measuredSpeedMmS = 0.0;
+
+    // Last FK sample for the web task; written by the loop under liveMux.
+    struct LiveSample {
+        bool valid = false;
+        double x = 0.0;
+        double y = 0.0;
+        double speedMmS = 0.0;
+    };
+    LiveSample live;
+    uint32_t liveSampleUs = 0;
+    mutable portMUX_TYPE liveMux = portMUX_INITIALIZER_UNLOCKED;
+    void publishLiveSample(bool movingNow);
+
+    template <typename T>
+    kin::Geometry<T> makeGeometry() const {
+        kin::Geometry<T> g;
+        g.topDistance = T(topDistance);
+        g.originX = T(minSafeXOffset);
+        g.originY = T(minSafeY);
+        g.d_t = T(d_t);
+        g.d_p = T(d_p);
+        g.d_m = T(d_m);
+        g.weight = T(mass_bot * g_constant);
+        g.wallOffset = T(midPulleyToWall);
+        return g;
+    }
+
     inline void getLeftTangentPoint(double frameX, double frameY, double gamma, double& x_PL, double& y_PL) const;
     inline void getRightTangentPoint(double frameX, double frameY, double gamma, double& x_PR, double& y_PR) const;
     void getBeltAngles(double frameX, double frameY, double gamma, double& phi_L, double& phi_R) const;
     void getBeltForces(double phi_L, double phi_R, double& F_L, double& F_R) const;
+    double swingFrequencyHz(double x, double y) const;
+    void tensionAccelLimits(double x, double y, double ux, double uy, double& accelMmS2, double& decelMmS2) const;
+    void dynamicAccelCarriage(double fromX, double fromY, double toX, double toY, double& accelMmS2, double& decelMmS2) const;
     double solveTorqueEquilibrium(double phi_L, double phi_R, double F_L, double F_R, double gamma_start) const;
     double getDilationCorrectedBeltLength(double belt_length_mm, double F_belt) const;
 
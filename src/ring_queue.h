@@ -0,0 +1,60 @@
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <stddef.h>
+
+// Fixed-capacity FIFO with indexed access (0 = oldest). The storage is part of
+// the object, so nothing is allocated after construction; push_back() refuses
+// when full and callers check space() before producing entries.
+template <typename T, size_t N>
+class RingQueue {
+public:
+    static constexpr size_t CAPACITY = N;
+
+    size_t size() const { return count; }
+    size_t space() const { return N - count; }
+    bool empty() const { return count == 0; }
+
+    T& operator[](size_t i) { return items[(head + i) % N]; }
+    const T& operator[](size_t i) const { return items[(head + i) % N]; }
+    T& front() { return items[head]; }
+    T& back() { return items[(head + count - 1) % N]; }
+
+    bool push_back(const T& item) {
+        if (count == N) return false;
+        items[(head + count) % N] = item;
+        count++;
+        return true;
+    }
+
+    void pop_front() {
+        if (count == 0) return;
+        head = (head + 1) % N;
+        count--;
+    }
+
+    // Append n slots with unspecified contents (an in-place expansion moves
+    // the entries it rewrites up into them first). Returns false if n > space().
+    bool grow(size_t n) {
+        if (n > N - count) return false;
+        count += n;
+        return true;
+    }
+
+    // Drop everything from index n on (in-place compaction ends with this).
+    void truncate(size_t n) {
+        if (n < count) count = n;
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+private:
+    T items[N];
+    size_t head = 0;
+    size_t count = 0;
+};
+
+#endif
@@ -1,47 +1,45 @@
 #include "runner.h"
 #include "tasks/interpolatingmovementtask.h"
 #include "tasks/pentask.h"
+#include "tasks/beltblocktask.h"
+#include "command_format.h"
 
 #include <Arduino.h>
 
 #include <stdexcept>
 #include <math.h>
 #include <algorithm>
-#include <deque>
-#include <vector>
 
 #include "service/weblog.h"
 #include <SD.h>
 #include "sd/sd_commands_bridge.h"
 
+namespace {
+// start() (web task) and the whole-file scans run from loop() (index build,
+// conversion) all drive the prefetch and reader; whoever claims readerBusy
+// first goes, the others give up.
+struct ReaderClaim {
+    std::atomic<bool>& flag;
+    bool held;
+    explicit ReaderClaim(std::atomic<bool>& f) : flag(f) {
+        bool expected = false;
+        held = flag.compare_exchange_strong(expected, true);
+    }
+    ~ReaderClaim() { if (held) flag.store(false); }
+};
+}
+
 using namespace std;
 
-static double angleDegBetween(const Movement::Point& a, const Movement::Point& b, const Movement::Point& c) {
-    const double v1x = b.x - a.x;
-    const double v1y = b.y - a.y;
-    const double v2x = c.x - b.x;
-    const double v2y = c.y - b.y;
-    const double l1 = sqrt(v1x*v1x + v1y*v1y);
-    const double l2 = sqrt(v2x*v2x + v2y*v2y);
-    if (l1 < 1e-9 || l2 < 1e-9) return 180.0;
-    double dot = (v1x*v2x + v1y*v2y) / (l1*l2);
-    if (dot > 1.0) dot = 1.0;
-    if (dot < -1.0) dot = -1.0;
-    return acos(dot) * 180.0 / PI;
-}
-
-// GRBL-style junction deviation limit (approx) -> max junction speed in mm/s.
-// thetaRad: angle between segments (0=straight)
-static double junctionSpeedMmS(double thetaRad, double accelMmS2, double junctionDeviationMm) {
-    if (thetaRad < 1e-6) return 1e9;
-    // Use GRBL formula: v = sqrt( (a * jd * sin(theta/2)) / (1 - sin(theta/2)) )
-    const double sinHalf = sin(thetaRad * 0.5);
-    if (sinHalf < 1e-9) return 1e9;
-    const double denom = (1.0 - sinHalf);
-    if (denom < 1e-9) return 1e9;
-    const double v2 = (accelMmS2 * junctionDeviationMm * sinHalf) / denom;
-    if (v2 <= 0.0) return 0.0;
-    return sqrt(v2);
+// Radius of the circle through a, b, c (0 when they are collinear).
+static double circumradius(const Movement::Point& a, const Movement::Point& b, const Movement::Point& c) {
+    const double abx = b.x - a.x, aby = b.y - a.y;
+    const double acx = c.x - a.x, acy = c.y - a.y;
+    const double bcx = c.x - b.x, bcy = c.y - b.y;
+    const double cross = abx * acy - aby * acx;
+    const double prod = sqrt((abx*abx + aby*aby) * (acx*acx + acy*acy) * (bcx*bcx + bcy*bcy));
+    if (fabs(cross) < 1e-9 * prod || fabs(cross) < 1e-12) return 0.0;
+    return prod / (2.0 * fabs(cross));
 }
 
 static int clampi(int v, int lo, int hi) {
@@ -50,7 +48,8 @@ static int clampi(int v, int lo, int hi) {
     return v;
 }
 
-Runner::Runner(Movement *movement, Pen *pen, Display *display) {
+Runner::Runner(Movement *movement, Pen *pen, Display *display)
+: penTaskSlot(true, pen, 0), moveTaskSlot(movement, Movement::Point(0, 0), 1.0) {
     this->movement = movement;
     this->pen = pen;
     this->display = display;
@@ -82,58 +81,11 @@ uint32_t Runner::getPenMovesTotal() const { return penMovesTotal; }
 uint32_t Runner::getPenMovesUp() const    { return penMovesUp; }
 uint32_t Runner::getPenMovesDown() const  { return penMovesDown; }
 
+int Runner::getSdPrefetchDepth() const       { return prefetch.depth(); }
+int Runner::getSdPrefetchReady() const       { return prefetch.ready(); }
+uint32_t Runner::getSdPrefetchStalls() const { return prefetch.stalls(); }
+uint32_t Runner::getSdWorstReadUs() const    { return prefetch.worstReadUs(); }
 
-static bool parseG2G3(const String& in, bool& outCw, double& outX, double& outY, double& outI, double& outJ) {
-    String s = in;
-    s.trim();
-    s.toLowerCase();
-    if (!(s.startsWith("g2") || s.startsWith("g3"))) return false;
-    outCw = s.startsWith("g2");
-
-    s.replace('\t', ' ');
-    while (s.indexOf("  ") >= 0) s.replace("  ", " ");
-
-    std::vector<String> toks;
-    int idx = 0;
-    while (idx < (int)s.length()) {
-        int sp = s.indexOf(' ', idx);
-        if (sp < 0) sp = s.length();
-        const String t = s.substring(idx, sp);
-        if (t.length() > 0) toks.push_back(t);
-        idx = sp + 1;
-    }
-    if (toks.size() < 2) return false;
-
-    bool hasLabel = false;
-    for (size_t i = 1; i < toks.size(); i++) {
-        if (toks[i].length() >= 2) {
-            const char k = toks[i].charAt(0);
-            if (k == 'x' || k == 'y' || k == 'i' || k == 'j') { hasLabel = true; break; }
-        }
-    }
-
-    if (hasLabel) {
-        bool hx=false, hy=false, hi=false, hj=false;
-        for (size_t i = 1; i < toks.size(); i++) {
-            const String t = toks[i];
-            if (t.length() < 2) continue;
-            const char k = t.charAt(0);
-            const double v = t.substring(1).toDouble();
-            if (k == 'x') { outX = v; hx=true; }
-            if (k == 'y') { outY = v; hy=true; }
-            if (k == 'i') { outI = v; hi=true; }
-            if (k == 'j') { outJ = v; hj=true; }
-        }
-        return hx && hy && hi && hj;
-    }
-
-    if (toks.size() < 5) return false;
-    outX = toks[1].toDouble();
-    outY = toks[2].toDouble();
-    outI = toks[3].toDouble();
-    outJ = toks[4].toDouble();
-    return true;
-}
 
 void Runner::setStartLine(size_t lineAfterHeader) {
     startLine = lineAfterHeader;
@@ -143,19 +95,20 @@ size_t Runner::getStartLine() const {
     return startLine;
 }
 
-void Runner::initTaskProvider() {
+void Runner::initTaskProvider(bool mayBuildIndex) {
     prefaceIx = 0;
     prefaceCount = 0;
     sequenceIx = 0;
     lookaheadQ.clear();
+    optimizedIx = 0;
+    pendingArc = PendingArc();
     eofReached = false;
     penIsDown = false;
 
     pendingPenUp = false;
     pendingPenUpPrevDown = false;
-    hasPushbackLine = false;
-    pushbackLine = String();
 
+    prefetch.stop();
     if (openedFile) openedFile.close();
 
     if (!sdCommandsEnsureMounted()) throw std::invalid_argument("SD not mounted");
@@ -163,14 +116,31 @@ void Runner::initTaskProvider() {
     openedFile = SD.open("/commands", FILE_READ);
     if (!openedFile) throw std::invalid_argument("No File");
 
-    String line = openedFile.readStringUntil('\n');
-    line.trim();
-    if (line.length() < 2 || line.charAt(0) != 'd') throw std::invalid_argument("bad file");
-    headerTotalDistance = line.substring(1).toDouble();
+    // Deep (re)start: seek to the indexed command before startLine instead of
+    // parsing everything above it. The index is built on the first restart from
+    // loop(); a start from a web handler without one skips linearly.
+    CommandsIndexEntry seekEntry;
+    double indexFirstX = 0.0, indexFirstY = 0.0;
+    bool seekIndexed = false;
+    if (startLine >= COMMANDS_INDEX_INTERVAL) {
+        seekIndexed = commandsIndexLookup(openedFile, startLine, seekEntry, indexFirstX, indexFirstY);
+        if (!seekIndexed && mayBuildIndex) {
+            CommandsIndexStats st;
+            if (commandsIndexBuild(prefetch, reader, st)) {
+                WebLog::info(String("Runner | restart index built: ") + st.entries + " entries, " + st.buildMs + " ms");
+                seekIndexed = commandsIndexLookup(openedFile, startLine, seekEntry, indexFirstX, indexFirstY);
+            }
+        }
+        openedFile.seek(0);
+    }
+
+    if (!prefetch.start(&openedFile)) throw std::invalid_argument("SD prefetch failed");
+    reader.begin(&prefetch);
 
-    String heightLine = openedFile.readStringUntil('\n');
-    heightLine.trim();
-    if (heightLine.length() < 2 || heightLine.charAt(0) != 'h') throw std::invalid_argument("bad file");
+    // text (d/h lines) or binary header, see command_format.h
+    double height = 0.0;
+    headerTotalDistance = 0.0;
+    if (!reader.readHeader(headerTotalDistance, height)) throw std::invalid_argument("bad file");
 
     startPosition = movement->getCoordinates();
     targetPosition = startPosition;
@@ -179,28 +149,52 @@ void Runner::initTaskProvider() {
     bool penDown = false;
     Movement::Point virtualPos = startPosition;
 
+    // Belt targets from the compiler are only valid for the geometry they were
+    // computed with, and there is no planner here to run them segment by segment.
+    compiledJob = reader.isCompiled();
+    if (compiledJob) {
+        const cmdbin::CompiledHeader& ch = reader.compiledHeader();
+        const char* mismatch = cmdbin::machineMismatch(ch.machine, movement->machine());
+        if (mismatch) {
+            WebLog::error(String("Runner | compiled job for another machine: ") + mismatch + " differs");
+            throw std::invalid_argument("compiled for another machine");
+        }
+        if (!movement->isStreaming()) {
+            WebLog::error("Runner | compiled job needs streamMotion");
+            throw std::invalid_argument("compiled job needs streaming");
+        }
+        virtualPos = Movement::Point(cmdbin::toMM(ch.startX), cmdbin::toMM(ch.startY));
+    }
+
     size_t consumed = 0;
-    while (consumed < startLine && openedFile.available()) {
-        String l = openedFile.readStringUntil('\n');
-        l.trim();
-        if (l.length() == 0) continue;
-
-        const char c0 = l.charAt(0);
-        if (c0 == 'p') {
-            const char c1 = (l.length() > 1) ? l.charAt(1) : '0';
-            penDown = (c1 == '1');
-            (void)penDown;
+    if (seekIndexed) {
+        prefetch.stop();
+        openedFile.seek(seekEntry.offset);
+        if (!prefetch.start(&openedFile)) throw std::invalid_argument("SD prefetch failed");
+        reader.resumeAt(seekEntry.offset, seekEntry.x, seekEntry.y, seekEntry.beltL, seekEntry.beltR);
+
+        consumed = seekEntry.line;
+        penDown = seekEntry.penDown != 0;
+        if (seekEntry.hasPoint) {
+            skippedDistance = Movement::distanceBetweenPoints(virtualPos, Movement::Point(indexFirstX, indexFirstY)) + seekEntry.distance;
+            virtualPos = Movement::Point(seekEntry.x, seekEntry.y);
+        }
+    }
+
+    CommandReader::Command cmd;
+    while (consumed < startLine && reader.next(cmd)) {
+        if (cmd.kind == CommandReader::Command::Pen) {
+            penDown = cmd.down;
+            consumed++;
+            continue;
+        }
+        if (cmd.kind == CommandReader::Command::Other) {
             consumed++;
             continue;
         }
 
-        int sep = l.indexOf(' ');
-        if (sep < 0) { consumed++; continue; }
-
-        double x = l.substring(0, sep).toDouble();
-        double y = l.substring(sep + 1).toDouble();
-
-        Movement::Point np(x, y);
+        // an arc is skipped as its chord
+        Movement::Point np(cmd.x, cmd.y);
         skippedDistance += Movement::distanceBetweenPoints(virtualPos, np);
         virtualPos = np;
         consumed++;
@@ -218,47 +212,74 @@ void Runner::initTaskProvider() {
     progress = -1;
 
     // Always force pen UP at (re)start to avoid "pen down while travel" situations.
-    prefaceSequence[prefaceCount++] = new PenTask(true, pen, penSettleMs);
+    prefaceSequence[prefaceCount++] = QueuedCommand(false);
 
-    if (startLine > 0) {
+    if (startLine > 0 || compiledJob) {
         if (!(virtualPos.x == startPosition.x && virtualPos.y == startPosition.y)) {
-            prefaceSequence[prefaceCount++] = new InterpolatingMovementTask(movement, virtualPos, moveSpeedSteps);
+            prefaceSequence[prefaceCount++] = QueuedCommand(virtualPos);
             startPosition = virtualPos;
         }
 
-        if (penDown) { prefaceSequence[prefaceCount++] = new PenTask(false, pen, penSettleMs); penIsDown = true; }
+        if (penDown) { prefaceSequence[prefaceCount++] = QueuedCommand(true); penIsDown = true; }
     }
 
+    resetPlanner_(startPosition);
+
     Movement::Point home = movement->getHomeCoordinates();
-    finishingSequence[0] = new PenTask(true, pen, penSettleMs);
-    finishingSequence[1] = new InterpolatingMovementTask(movement, home, moveSpeedSteps);
+    finishingSequence[0] = QueuedCommand(false);
+    finishingSequence[1] = QueuedCommand(home);
+}
+
+// Append the remaining points of the pending G2/G3 arc up to the fill limit.
+// Returns true once the arc is complete.
+bool Runner::drainArc_() {
+    PendingArc& arc = pendingArc;
+    while (arc.active && lookaheadQ.size() < LOOKAHEAD_MAX) {
+        arc.k++;
+        const double a = arc.a0 + arc.sweep * (double)arc.k / (double)arc.n;
+        const Movement::Point p = (arc.k >= arc.n) ? arc.end : Movement::Point(arc.cx + cos(a) * arc.radius, arc.cy + sin(a) * arc.radius);
+        QueuedCommand q(p, true);
+        q.radiusMM = (float)arc.radius;
+        lookaheadQ.push_back(q);
+        if (arc.k >= arc.n) arc.active = false;
+    }
+    return !arc.active;
 }
 
 bool Runner::fillLookaheadQueue() {
     if (!openedFile) return false;
-    const int maxSegments = movement->getPlannerConfig().lookaheadSegments;
+    const auto cfg = movement->getPlannerConfig();
+    const int minSegments = cfg.lookaheadSegments;
+    // room for the largest single line: a pen flush plus one move
+    constexpr size_t FILL_RESERVE = 2;
 
     Movement::Point virtualPos = startPosition;
-    for (auto it = lookaheadQ.rbegin(); it != lookaheadQ.rend(); ++it) {
-        if (it->type == QueuedCommand::Move) { virtualPos = it->p; break; }
+    for (size_t i = lookaheadQ.size(); i-- > 0;) {
+        if (lookaheadQ[i].type == QueuedCommand::Move) { virtualPos = lookaheadQ[i].p(); break; }
     }
 
-    while (!eofReached && (int)lookaheadQ.size() < maxSegments && openedFile.available()) {
-        String line;
-        if (hasPushbackLine) {
-            line = pushbackLine;
-            hasPushbackLine = false;
-            pushbackLine = String();
-        } else {
-            line = openedFile.readStringUntil('\n');
+    auto needMore = [&]() {
+        const int n = (int)lookaheadQ.size();
+        if (n < minSegments) return true;
+        if (!(cfg.lookaheadSeconds > 0.0) || n >= (int)LOOKAHEAD_MAX) return false;
+        timeQueue_();
+        return timedS < cfg.lookaheadSeconds;
+    };
+
+    const size_t sizeBefore = lookaheadQ.size();
+    while (!eofReached && lookaheadQ.space() > FILL_RESERVE && needMore() && (pendingArc.active || reader.available())) {
+        if (pendingArc.active) {
+            if (!drainArc_()) break;
+            // the arc may have been started by an earlier fill
+            virtualPos = pendingArc.end;
+            continue;
         }
-        line.trim();
-        if (line.length() == 0) continue;
 
-        const char c0 = line.charAt(0);
-        if (c0 == 'p') {
-            const char c1 = (line.length() > 1) ? line.charAt(1) : '0';
-            const bool down = (c1 == '1');
+        CommandReader::Command cmd;
+        if (!reader.next(cmd)) break;
+
+        if (cmd.kind == CommandReader::Command::Pen) {
+            const bool down = cmd.down;
 
             // If we already deferred a pen-up and we see a pen-down without a move in between,
             // it cancels out (p0 then p1) -> drop both.
@@ -278,7 +299,7 @@ bool Runner::fillLookaheadQueue() {
 
             // Flush pending pen-up before pen-down (no merge possible here).
             if (pendingPenUp) {
-                lookaheadQ.emplace_back(false);
+                lookaheadQ.push_back(QueuedCommand(false));
                 pendingPenUp = false;
                 pendingPenUpPrevDown = false;
             }
@@ -291,22 +312,21 @@ bool Runner::fillLookaheadQueue() {
                 }
             }
 
-            lookaheadQ.emplace_back(down);
+            lookaheadQ.push_back(QueuedCommand(down));
             continue;
         }
 
-        bool cw = false;
-        double ax = 0.0, ay = 0.0, ai = 0.0, aj = 0.0;
-        if (parseG2G3(line, cw, ax, ay, ai, aj)) {
+        if (cmd.kind == CommandReader::Command::Arc) {
             const auto cfg = movement->getPlannerConfig();
-            const Movement::Point end(ax, ay);
+            const bool cw = cmd.cw;
+            const Movement::Point end(cmd.x, cmd.y);
 
-            const double cx = virtualPos.x + ai;
-            const double cy = virtualPos.y + aj;
+            const double cx = virtualPos.x + cmd.i;
+            const double cy = virtualPos.y + cmd.j;
             const double rs = hypot(virtualPos.x - cx, virtualPos.y - cy);
             const double re = hypot(end.x - cx, end.y - cy);
             if (rs < 1e-6 || fabs(rs - re) > 0.25) {
-                lookaheadQ.emplace_back(end);
+                lookaheadQ.push_back(QueuedCommand(end));
                 virtualPos = end;
                 continue;
             }
@@ -324,7 +344,7 @@ bool Runner::fillLookaheadQueue() {
             const double sweep = da;
             const double sweepAbs = fabs(sweep);
             if (sweepAbs < 1e-6) {
-                lookaheadQ.emplace_back(end);
+                lookaheadQ.push_back(QueuedCommand(end));
                 virtualPos = end;
                 continue;
             }
@@ -343,86 +363,397 @@ bool Runner::fillLookaheadQueue() {
             if (n < 1) n = 1;
             if (n > 4096) n = 4096;
 
-            for (int k = 1; k <= n; k++) {
-                const double t = (double)k / (double)n;
-                const double a = a0 + sweep * t;
-                const double x = cx + cos(a) * rs;
-                const double y = cy + sin(a) * rs;
-                lookaheadQ.emplace_back(Movement::Point(x, y), true);
-            }
+            // expanded by drainArc_() as the queue has room
+            pendingArc.active = true;
+            pendingArc.cx = cx;
+            pendingArc.cy = cy;
+            pendingArc.radius = rs;
+            pendingArc.a0 = a0;
+            pendingArc.sweep = sweep;
+            pendingArc.end = end;
+            pendingArc.n = n;
+            pendingArc.k = 0;
 
             virtualPos = end;
             continue;
         }
 
-        int sep = line.indexOf(' ');
-        if (sep < 0) continue;
-
-        double x = line.substring(0, sep).toDouble();
-        double y = line.substring(sep + 1).toDouble();
-        Movement::Point np(x, y);
+        if (cmd.kind != CommandReader::Command::Move) continue;
+        Movement::Point np(cmd.x, cmd.y);
 
         // If we have a deferred pen-up, we may merge: p0 -> short move -> p1.
         if (pendingPenUp && penMergeMm > 0.0 && pendingPenUpPrevDown) {
             // Peek next non-empty line (one-line lookahead).
-            String nextLine = openedFile.readStringUntil('\n');
-            nextLine.trim();
-            while (nextLine.length() == 0 && openedFile.available()) {
-                nextLine = openedFile.readStringUntil('\n');
-                nextLine.trim();
-            }
+            CommandReader::Command nextCmd;
+            const bool peeked = reader.next(nextCmd);
 
-            const bool nextIsPenDown = (nextLine.length() > 1 && nextLine.charAt(0) == 'p' && nextLine.charAt(1) == '1');
+            const bool nextIsPenDown = peeked && nextCmd.kind == CommandReader::Command::Pen && nextCmd.down;
             if (nextIsPenDown) {
                 const double d = Movement::distanceBetweenPoints(virtualPos, np);
                 if (d <= penMergeMm) {
                     // Merge: keep pen down, draw through, drop both p0 and following p1.
                     pendingPenUp = false;
                     pendingPenUpPrevDown = false;
-                    lookaheadQ.emplace_back(np);
+                    lookaheadQ.push_back(QueuedCommand(np));
                     virtualPos = np;
                     continue;
                 }
             }
 
             // Not merged: push back the peeked line for normal processing.
-            hasPushbackLine = true;
-            pushbackLine = nextLine;
+            if (peeked) reader.unread();
         }
 
         // Flush pending pen-up if any (no merge applied).
         if (pendingPenUp) {
-            lookaheadQ.emplace_back(false);
+            lookaheadQ.push_back(QueuedCommand(false));
             pendingPenUp = false;
             pendingPenUpPrevDown = false;
         }
 
-        lookaheadQ.emplace_back(np);
+        lookaheadQ.push_back(QueuedCommand(np));
         virtualPos = np;
     }
 
-    if (!openedFile.available()) eofReached = true;
-    optimizeLookaheadQueue();
+    if (!reader.available() && !pendingArc.active) eofReached = true;
+    if (lookaheadQ.size() == sizeBefore) return !lookaheadQ.empty();
+
+    // optimize only rewrites the queue from 'from' on. The junction at its
+    // start may change with it, so the block ending there is planned again.
+    const size_t from = optimizeLookaheadQueue();
+    const size_t keep = from > 0 ? from - 1 : 0;
+    if (plannedIx > keep) plannedIx = keep;
+    if (geomIx > keep) geomIx = keep;
+    planLookahead_();
     return !lookaheadQ.empty();
 }
 
+void Runner::resetPlanner_(const Movement::Point& from) {
+    planTail = PlannedTail();
+    planTail.p = from;
+    plannedIx = 0;
+    geomIx = 0;
+
+    timedS = 0.0;
+    timedIx = 0;
+    timedPos = from;
+    timedDown = penIsDown;
+}
+
+void Runner::timeQueue_() {
+    const double speedScale = movement->isFeedMode() ? 1.0 : stepsToMM(1);
+    for (; timedIx < lookaheadQ.size(); timedIx++) {
+        QueuedCommand& q = lookaheadQ[timedIx];
+        if (q.type == QueuedCommand::Pen) {
+            timedDown = q.penDown;
+            q.tNomS = penSettleMs / 1000.0f;
+        } else {
+            const double v = std::max(1e-3, (timedDown ? printSpeedSteps : moveSpeedSteps) * speedScale);
+            q.tNomS = (float)(Movement::distanceBetweenPoints(timedPos, q.p()) / v);
+            timedPos = q.p();
+        }
+        timedS += q.tNomS;
+    }
+}
+
+// Entries from 'from' on are about to be rewritten: take their time out.
+void Runner::untimeFrom_(size_t from) {
+    if (from >= timedIx) return;
+    for (size_t k = from; k < timedIx; k++) timedS -= lookaheadQ[k].tNomS;
+    if (from == 0 || timedS < 0.0) timedS = 0.0;
+    timedIx = from;
+    if (from == 0) {
+        timedPos = planTail.p;
+        timedDown = penIsDown;
+    } else {
+        bool moveBefore;
+        stateBefore_(from, timedPos, timedDown, moveBefore);
+    }
+}
 
-void Runner::optimizeLookaheadQueue() {
+void Runner::planLookahead_() {
+    if (!movement || lookaheadQ.empty()) return;
+
+    // Speed math runs in KinScalar (float with VPLOTTER_KIN_FLOAT); points and
+    // belt steps stay absolute double/int.
     const auto cfg = movement->getPlannerConfig();
+    const KinScalar accelSteps = (KinScalar)movement->getMotionTuning().acceleration;
+    const KinScalar mmPerStep = (KinScalar)stepsToMM(1);
+
+    try {
+        if (!planTail.hasBelt) {
+            movement->estimateBeltSteps(planTail.p.x, planTail.p.y, planTail.beltL, planTail.beltR);
+            planTail.hasBelt = true;
+        }
+
+        // A speed change invalidates every cached nominal speed.
+        if (geomPrintSpeed != printSpeedSteps || geomMoveSpeed != moveSpeedSteps) {
+            geomPrintSpeed = printSpeedSteps;
+            geomMoveSpeed = moveSpeedSteps;
+            geomIx = 0;
+            plannedIx = 0;
+        }
+
+        // Block geometry: length, nominal speed and accel in mm, junction limit.
+        // Belt steps are cached per point, so IK runs once per queued move, and
+        // entries before geomIx keep theirs: the loop resumes from the state
+        // after entry geomIx - 1.
+        Movement::Point prev = planTail.p;
+        int prevL = planTail.beltL;
+        int prevR = planTail.beltR;
+        KinScalar prevDX = planTail.dx;
+        KinScalar prevDY = planTail.dy;
+        int prevBeltDL = planTail.dL;
+        int prevBeltDR = planTail.dR;
+        KinScalar prevVNom = planTail.vNom;
+        KinScalar prevRadius = planTail.radiusMM;
+        QueuedCommand* prevCmd = nullptr;
+        bool fromRest = planTail.fromRest;
+        bool penDown = penIsDown;
+
+        // last move before index i, planTail if none
+        auto moveBefore = [&](size_t i) -> const QueuedCommand* {
+            while (i-- > 0) {
+                if (lookaheadQ[i].type == QueuedCommand::Move) return &lookaheadQ[i];
+            }
+            return nullptr;
+        };
 
-    // Remove too-short move segments (skip noise)
-    Movement::Point prev = startPosition;
-    for (auto it = lookaheadQ.begin(); it != lookaheadQ.end();) {
-        if (it->type == QueuedCommand::Move) {
-            const double d = Movement::distanceBetweenPoints(prev, it->p);
-            if (!it->protect && d < cfg.minSegmentLenMM) {
-                it = lookaheadQ.erase(it);
+        const size_t g = std::min(geomIx, lookaheadQ.size());
+        if (g > 0) {
+            QueuedCommand& last = lookaheadQ[g - 1];
+            if (last.type == QueuedCommand::Pen) {
+                penDown = last.penDown;
+                fromRest = true;
+                if (const QueuedCommand* m = moveBefore(g - 1)) {
+                    prev = m->p();
+                    prevL = m->beltL;
+                    prevR = m->beltR;
+                }
+            } else {
+                Movement::Point before = planTail.p;
+                int beforeL = planTail.beltL, beforeR = planTail.beltR;
+                if (const QueuedCommand* m = moveBefore(g - 1)) {
+                    before = m->p();
+                    beforeL = m->beltL;
+                    beforeR = m->beltR;
+                }
+                prev = last.p();
+                prevL = last.beltL;
+                prevR = last.beltR;
+                prevDX = (KinScalar)(prev.x - before.x);
+                prevDY = (KinScalar)(prev.y - before.y);
+                prevBeltDL = prevL - beforeL;
+                prevBeltDR = prevR - beforeR;
+                prevVNom = last.vNom;
+                prevRadius = last.radiusMM;
+                prevCmd = &last;
+                fromRest = false;
+                penDown = last.penDown;
+            }
+        }
+
+        for (size_t k = g; k < lookaheadQ.size(); k++) {
+            QueuedCommand& c = lookaheadQ[k];
+            if (c.type == QueuedCommand::Pen) {
+                penDown = c.penDown;
+                fromRest = true;
+                prevCmd = nullptr;
                 continue;
             }
-            prev = it->p;
+
+            if (!c.hasBelt) {
+                movement->estimateBeltSteps(c.p().x, c.p().y, c.beltL, c.beltR);
+                c.hasBelt = true;
+            }
+
+            const KinScalar dx = (KinScalar)(c.p().x - prev.x);
+            const KinScalar dy = (KinScalar)(c.p().y - prev.y);
+            const KinScalar len = kin::length(dx, dy);
+            const int beltDL = c.beltL - prevL;
+            const int beltDR = c.beltR - prevR;
+            const int maxDelta = std::max(abs(beltDL), abs(beltDR));
+            const KinScalar baseSpeed = (KinScalar)(penDown ? printSpeedSteps : moveSpeedSteps);
+            const KinScalar minSpeed = (KinScalar)1e-3;
+            c.penDown = penDown;
+
+            // mm of path per step of the dominant motor
+            const KinScalar r = (len > (KinScalar)1e-6 && maxDelta > 0) ? (len / (KinScalar)maxDelta) : mmPerStep;
+
+            const KinScalar vNom = cfg.feedMode ? std::max(minSpeed, std::min(baseSpeed, (KinScalar)cfg.maxStepRate * r))
+                                                : std::max(minSpeed, baseSpeed * r);
+            KinScalar accel = std::max(minSpeed, accelSteps * r);
+            KinScalar decel = accel;
+            if (cfg.dynamicAccel) {
+                double a = accel, d = decel;
+                movement->dynamicAccelLimits(prev, c.p(), a, d);
+                accel = (KinScalar)a;
+                decel = (KinScalar)d;
+                // without the stream each motor ramps symmetrically (see startSegment)
+                if (!movement->isStreaming()) accel = decel = std::min(accel, decel);
+            }
+            c.lenMM = (float)len;
+            c.vNom = (float)vNom;
+            c.accel = (float)accel;
+            c.decel = (float)decel;
+
+            // Centripetal limit at the vertex this block starts from; it caps
+            // the junction and the cruise of both blocks that meet there.
+            KinScalar vCurve = 0;
+            c.vCurve = 0.0f;
+            if (cfg.curvatureSpeed && !fromRest && len > (KinScalar)1e-6) {
+                KinScalar radius = 0;
+                if (c.radiusMM > 0.0f && std::fabs(prevRadius - (KinScalar)c.radiusMM) < (KinScalar)1e-6) {
+                    radius = c.radiusMM;
+                } else {
+                    const Movement::Point before(prev.x - prevDX, prev.y - prevDY);
+                    if (prevDX * prevDX + prevDY * prevDY > (KinScalar)1e-12) radius = (KinScalar)circumradius(before, prev, c.p());
+                }
+                if (radius > 0) {
+                    vCurve = std::sqrt(std::min(accel, decel) * radius);
+                    c.vCurve = (float)vCurve;
+                    if (prevCmd && (prevCmd->vCurve <= 0.0f || vCurve < prevCmd->vCurve)) prevCmd->vCurve = (float)vCurve;
+                }
+            }
+
+            if (fromRest || len < (KinScalar)1e-6) {
+                c.vJunction = 0.0f;
+            } else if (cfg.timeOptimal) {
+                // Per-motor limits only: the belt velocity change at the junction.
+                const KinScalar vJ = std::min(prevVNom, vNom);
+                c.vJunction = (float)std::min(vJ, Movement::beltJunctionSpeedMmS(prevBeltDL, prevBeltDR, beltDL, beltDR, len,
+                                                                          accelSteps, cfg.junctionDeviationMM));
+            } else {
+                KinScalar vJ = std::min(prevVNom, vNom);
+
+                const KinScalar prevLen = kin::length(prevDX, prevDY);
+                if (prevLen > (KinScalar)1e-6) {
+                    KinScalar dot = (dx * prevDX + dy * prevDY) / (len * prevLen);
+                    dot = std::max((KinScalar)-1, std::min((KinScalar)1, dot));
+                    const KinScalar theta = std::acos(dot); // 0 = straight
+
+                    // Angle-based slowdown (existing UI tuning).
+                    KinScalar f = (KinScalar)1 - (theta / (KinScalar)PI) * (KinScalar)cfg.cornerSlowdown;
+                    if (f < (KinScalar)cfg.minCornerFactor) f = (KinScalar)cfg.minCornerFactor;
+                    if (f > (KinScalar)1) f = 1;
+                    vJ *= f;
+
+                    // Physics-ish junction limit.
+                    vJ = std::min(vJ, Movement::junctionSpeedMmS(theta, accel, cfg.junctionDeviationMM));
+                }
+                c.vJunction = (float)vJ;
+            }
+            if (vCurve > 0 && vCurve < c.vJunction) c.vJunction = (float)vCurve;
+
+            prev = c.p();
+            prevL = c.beltL;
+            prevR = c.beltR;
+            prevDX = dx;
+            prevDY = dy;
+            prevBeltDL = beltDL;
+            prevBeltDR = beltDR;
+            prevVNom = vNom;
+            prevRadius = c.radiusMM;
+            prevCmd = &c;
+            fromRest = false;
+        }
+        geomIx = lookaheadQ.size();
+    } catch (...) {
+        // Not homed yet (dry run): leave the queue unplanned, tasks use base speed.
+        return;
+    }
+
+    const size_t n = lookaheadQ.size();
+    if (plannedIx > n) plannedIx = n;
+
+    // Reverse pass: nothing is known after the buffer, so it must end at rest.
+    const KinScalar two = 2;
+    KinScalar next = 0;
+    for (size_t k = n; k-- > plannedIx;) {
+        auto& c = lookaheadQ[k];
+        if (c.type == QueuedCommand::Pen) { next = 0; continue; }
+        const KinScalar vMax = std::sqrt(next * next + two * c.decel * c.lenMM);
+        c.vEntry = (float)std::min((KinScalar)c.vJunction, vMax);
+        next = c.vEntry;
+    }
+
+    // Forward pass: an entry speed must be reachable from the block before it.
+    KinScalar prevExit;
+    if (plannedIx == 0) {
+        prevExit = planTail.fromRest ? 0 : std::sqrt(planTail.vEntry * planTail.vEntry + two * planTail.accel * planTail.lenMM);
+    } else {
+        const auto& b = lookaheadQ[plannedIx - 1];
+        prevExit = (b.type == QueuedCommand::Pen) ? 0 : std::sqrt((KinScalar)b.vEntry * b.vEntry + two * b.accel * b.lenMM);
+    }
+    for (size_t k = plannedIx; k < n; k++) {
+        auto& c = lookaheadQ[k];
+        if (c.type == QueuedCommand::Pen) {
+            prevExit = 0;
+            if (plannedIx == k) plannedIx = k + 1;
+            continue;
+        }
+        if (c.vEntry >= prevExit) {
+            // acceleration limited: cannot improve with more lookahead
+            c.vEntry = prevExit;
+            plannedIx = k + 1;
+        } else if (c.vEntry >= c.vJunction) {
+            plannedIx = k + 1;
+        }
+        prevExit = std::sqrt((KinScalar)c.vEntry * c.vEntry + two * c.accel * c.lenMM);
+    }
+}
+
+
+// Last move before index i (startPosition if none) and the pen state there.
+void Runner::stateBefore_(size_t i, Movement::Point& pos, bool& penDown, bool& moveBefore) const {
+    pos = startPosition;
+    penDown = penIsDown;
+    moveBefore = false;
+    bool havePos = false;
+    bool havePen = false;
+    for (size_t k = i; k-- > 0 && !(havePos && havePen);) {
+        const QueuedCommand& q = lookaheadQ[k];
+        if (q.type == QueuedCommand::Move && !havePos) {
+            pos = q.p();
+            havePos = true;
+            if (!havePen) moveBefore = true;
+        } else if (q.type == QueuedCommand::Pen && !havePen) {
+            penDown = q.penDown;
+            havePen = true;
+        }
+    }
+}
+
+// Entries before optimizedIx went through these passes already. They restart
+// at the last move before it (its vertex only now sees the move after it and
+// pen changes behind it may merge with new ones), so a top-up costs the new
+// tail, not the whole queue. Returns the first index that may have changed.
+size_t Runner::optimizeLookaheadQueue() {
+    const auto cfg = movement->getPlannerConfig();
+
+    size_t from = std::min(optimizedIx, lookaheadQ.size());
+    while (from > 0 && lookaheadQ[from - 1].type != QueuedCommand::Move) from--;
+    if (from > 0) from--;
+    untimeFrom_(from);
+
+    Movement::Point startPos;
+    bool startPenDown, moveBefore;
+    stateBefore_(from, startPos, startPenDown, moveBefore);
+
+    // Remove too-short move segments (skip noise); the passes below compact the
+    // queue in place (write index w never passes the read index).
+    Movement::Point prev = startPos;
+    size_t w = from;
+    for (size_t r = from; r < lookaheadQ.size(); r++) {
+        const QueuedCommand cmd = lookaheadQ[r];
+        if (cmd.type == QueuedCommand::Move) {
+            const double d = Movement::distanceBetweenPoints(prev, cmd.p());
+            if (!cmd.protect && d < cfg.minSegmentLenMM) continue;
+            prev = cmd.p();
         }
-        ++it;
+        lookaheadQ[w++] = cmd;
     }
+    lookaheadQ.truncate(w);
 
     // ------------------------------------------------------------------
     // NEW: Reduce pen up/down churn safely (no geometry change):
@@ -431,16 +762,17 @@ void Runner::optimizeLookaheadQueue() {
     // - Drop pen toggles that are never followed by a move.
     // ------------------------------------------------------------------
     {
-        std::deque<QueuedCommand> out;
-        Movement::Point cur = startPosition;
+        Movement::Point cur = startPos;
+        w = from;
 
-        bool penDown = false;          // assume start is UP
+        // start from the real pen state (the queue is optimized on every top-up)
+        bool penDown = startPenDown;
         bool pending = false;
         bool pendingState = false;
 
         auto flushPendingIfNeeded = [&]() {
             if (pending) {
-                out.emplace_back(pendingState); // Pen command
+                lookaheadQ[w++] = QueuedCommand(pendingState); // Pen command
                 penDown = pendingState;
                 pending = false;
             }
@@ -448,7 +780,9 @@ void Runner::optimizeLookaheadQueue() {
 
         const double eps = 1e-6;
 
-        for (const auto &cmd : lookaheadQ) {
+        const size_t n = lookaheadQ.size();
+        for (size_t r = from; r < n; r++) {
+            const QueuedCommand cmd = lookaheadQ[r];
             if (cmd.type == QueuedCommand::Pen) {
                 // ignore redundant state
                 if (cmd.penDown == penDown) continue;
@@ -460,7 +794,7 @@ void Runner::optimizeLookaheadQueue() {
             }
 
             // Move
-            const double d = Movement::distanceBetweenPoints(cur, cmd.p);
+            const double d = Movement::distanceBetweenPoints(cur, cmd.p());
             if (d < eps) {
                 // no-op move => drop
                 continue;
@@ -469,42 +803,185 @@ void Runner::optimizeLookaheadQueue() {
             // there is a real move: apply pending pen state right before it
             flushPendingIfNeeded();
 
-            out.push_back(cmd);
-            cur = cmd.p;
+            lookaheadQ[w++] = cmd;
+            cur = cmd.p();
         }
 
-        // If pending is still set here, it means a pen change at end without movement -> drop it.
-        lookaheadQ.swap(out);
+        // If pending is still set here, it means a pen change at end without movement -> drop it,
+        // unless more lines follow (the queue is topped up, the move comes later).
+        if (pending && !eofReached) lookaheadQ[w++] = QueuedCommand(pendingState);
+        lookaheadQ.truncate(w);
     }
 
-    // Merge collinear points for consecutive Move-Move-Move blocks between pen commands
-    bool changed = true;
-    while (changed) {
-        changed = false;
-        Movement::Point anchor = startPosition;
-        for (size_t i = 0; i + 2 < lookaheadQ.size(); ++i) {
-            if (lookaheadQ[i].type != QueuedCommand::Move) {
-                anchor = startPosition;
-                continue;
-            }
-            if (i > 0 && lookaheadQ[i-1].type == QueuedCommand::Move) anchor = lookaheadQ[i-1].p;
-            if (lookaheadQ[i+1].type != QueuedCommand::Move || lookaheadQ[i+2].type != QueuedCommand::Move) continue;
+    if (cfg.simplifyToleranceMM > 0.0) simplifyLookaheadQueue_(from, cfg.simplifyToleranceMM);
 
-            if (lookaheadQ[i].protect || lookaheadQ[i+1].protect || lookaheadQ[i+2].protect) continue;
+    if (cfg.cornerBlendMM > 0.0) blendCorners_(from, cfg.cornerBlendMM);
 
-            const auto &a = anchor;
-            const auto &b = lookaheadQ[i].p;
-            const auto &c = lookaheadQ[i+1].p;
-            const auto &d = lookaheadQ[i+2].p;
+    optimizedIx = lookaheadQ.size();
+    return from;
+}
 
-            const double ang = angleDegBetween(a, b, c);
-            if (fabs(ang) <= cfg.collinearDeg || fabs(180.0 - ang) <= cfg.collinearDeg) {
-                lookaheadQ.erase(lookaheadQ.begin() + (long)(i+1));
-                changed = true;
-                break;
-            }
+static double distanceToSegment(const Movement::Point& p, const Movement::Point& a, const Movement::Point& b) {
+    const double abx = b.x - a.x, aby = b.y - a.y;
+    const double len2 = abx * abx + aby * aby;
+    double t = (len2 > 1e-18) ? ((p.x - a.x) * abx + (p.y - a.y) * aby) / len2 : 0.0;
+    t = std::max(0.0, std::min(1.0, t));
+    return hypot(p.x - (a.x + abx * t), p.y - (a.y + aby * t));
+}
+
+// Streaming line simplification in one pass, compacting the queue in place.
+// From the last kept point (anchor) the newest kept point is replaced by the
+// next one as long as every original point since the anchor stays within
+// toleranceMM of the segment anchor -> next (a windowed Douglas-Peucker test,
+// against the segment so reversals survive). Protected points, pen changes and
+// points of earlier passes are never dropped. Cost is O(n * WINDOW).
+void Runner::simplifyLookaheadQueue_(size_t from, double toleranceMM) {
+    constexpr int WINDOW = 32;
+    Movement::Point window[WINDOW];
+    int windowCount = 0;
+
+    Movement::Point anchor;
+    bool penDown, moveBefore;
+    stateBefore_(from, anchor, penDown, moveBefore);
+
+    size_t w = from;
+    const size_t n = lookaheadQ.size();
+    for (size_t r = from; r < n; r++) {
+        QueuedCommand cmd = lookaheadQ[r];
+        if (cmd.type == QueuedCommand::Pen) {
+            // points before the pen change stay; the next stroke starts fresh
+            if (w > 0 && lookaheadQ[w - 1].type == QueuedCommand::Move) anchor = lookaheadQ[w - 1].p();
+            windowCount = 0;
+            lookaheadQ[w++] = cmd;
+            continue;
+        }
+
+        bool replace = windowCount > 0 && windowCount < WINDOW && !cmd.simplified;
+        if (replace) {
+            const QueuedCommand& last = lookaheadQ[w - 1];
+            replace = last.type == QueuedCommand::Move && !last.protect && !last.simplified;
+        }
+        for (int k = 0; replace && k < windowCount; k++) {
+            if (distanceToSegment(window[k], anchor, cmd.p()) > toleranceMM) replace = false;
+        }
+
+        if (replace) {
+            lookaheadQ[w - 1] = cmd;
+        } else {
+            if (windowCount > 0) anchor = lookaheadQ[w - 1].p();
+            windowCount = 0;
+            lookaheadQ[w++] = cmd;
+        }
+        window[windowCount++] = cmd.p();
+    }
+    lookaheadQ.truncate(w);
+
+    // the next top-up keeps these as they are: the dropped points are gone
+    for (size_t i = from; i < w; i++) lookaheadQ[i].simplified = true;
+}
+
+// Replace each drawing vertex by a circular fillet tangent to both segments.
+// For a turn theta the arc passes the vertex at R * (1/cos(theta/2) - 1), which
+// sets R from the allowed deviation; the tangent points are R * tan(theta/2)
+// from the vertex and may use at most half of either segment. Fillet points are
+// protected and carry their radius (curvatureSpeed uses it as is).
+void Runner::blendCorners_(size_t from, double maxDeviationMM) {
+    constexpr double MIN_TURN = 1.0 * PI / 180.0;     // nothing to gain below
+    constexpr double MAX_TURN = 170.0 * PI / 180.0;   // reversal: stop instead
+    constexpr int MAX_ARC_POINTS = 32;
+    const double chordErr = std::max(0.005, maxDeviationMM * 0.25);
+
+    // Entries before 'from' were blended by an earlier pass and stay put. The
+    // rest is moved up to the end of the free space and read from there, the
+    // output is written from 'from' on, so the expansion needs no second
+    // buffer. A corner stays sharp when the gap has no room for its fillet.
+    const size_t count = lookaheadQ.size();
+    if (from >= count) return;
+
+    Movement::Point before = planTail.p;
+    bool penDown = penIsDown;
+    bool hasBefore = !planTail.fromRest;
+    if (from > 0) stateBefore_(from, before, penDown, hasBefore);
+
+    const size_t gap = lookaheadQ.space();
+    lookaheadQ.grow(gap);
+    for (size_t k = count; k-- > from;) lookaheadQ[k + gap] = lookaheadQ[k];
+
+    size_t w = from;
+    const size_t end = count + gap;
+    for (size_t r = from + gap; r < end; r++) {
+        const QueuedCommand cmd = lookaheadQ[r];
+        const bool hasAfter = r + 1 < end && lookaheadQ[r + 1].type == QueuedCommand::Move;
+        const QueuedCommand next = hasAfter ? lookaheadQ[r + 1] : cmd;
+
+        if (cmd.type == QueuedCommand::Pen) {
+            penDown = cmd.penDown;
+            hasBefore = false;
+            lookaheadQ[w++] = cmd;
+            continue;
+        }
+
+        // slots [w, r] are free (cmd is copied), the fillet writes up to 1 + MAX_ARC_POINTS
+        if (!penDown || !hasBefore || !hasAfter || cmd.radiusMM > 0.0f || next.radiusMM > 0.0f ||
+            r + 1 - w < (size_t)MAX_ARC_POINTS + 1) {
+            lookaheadQ[w++] = cmd;
+            before = cmd.p();
+            hasBefore = true;
+            continue;
+        }
+
+        const Movement::Point b = cmd.p();
+        const Movement::Point c = next.p();
+        const double l1 = Movement::distanceBetweenPoints(before, b);
+        const double l2 = Movement::distanceBetweenPoints(b, c);
+        double theta = 0.0;
+        if (l1 > 1e-6 && l2 > 1e-6) {
+            double dot = ((b.x - before.x) * (c.x - b.x) + (b.y - before.y) * (c.y - b.y)) / (l1 * l2);
+            dot = std::max(-1.0, std::min(1.0, dot));
+            theta = acos(dot);
+        }
+        if (theta < MIN_TURN || theta > MAX_TURN) {
+            lookaheadQ[w++] = cmd;
+            before = b;
+            continue;
+        }
+
+        const double half = 0.5 * theta;
+        double radius = maxDeviationMM * cos(half) / (1.0 - cos(half));
+        double tangent = radius * tan(half);
+        const double maxTangent = 0.5 * std::min(l1, l2);
+        if (tangent > maxTangent) {
+            tangent = maxTangent;
+            radius = tangent / tan(half);
+        }
+
+        const double u1x = (b.x - before.x) / l1, u1y = (b.y - before.y) / l1;
+        const double u2x = (c.x - b.x) / l2, u2y = (c.y - b.y) / l2;
+        const Movement::Point p1(b.x - u1x * tangent, b.y - u1y * tangent);
+
+        // center on the inside of the turn
+        const double side = (u1x * u2y - u1y * u2x > 0.0) ? 1.0 : -1.0;
+        const double cx = p1.x - u1y * side * radius;
+        const double cy = p1.y + u1x * side * radius;
+
+        double step = 2.0 * acos(std::max(-1.0, std::min(1.0, 1.0 - chordErr / radius)));
+        if (!(step > 1e-6)) step = theta;
+        int n = (int)ceil(theta / step);
+        if (n < 1) n = 1;
+        if (n > MAX_ARC_POINTS) n = MAX_ARC_POINTS;
+
+        lookaheadQ[w++] = QueuedCommand(p1, true);
+
+        const double a0 = atan2(p1.y - cy, p1.x - cx);
+        for (int k = 1; k <= n; k++) {
+            const double a = a0 + side * theta * (double)k / (double)n;
+            QueuedCommand q(Movement::Point(cx + cos(a) * radius, cy + sin(a) * radius), true);
+            q.radiusMM = (float)radius;
+            lookaheadQ[w++] = q;
         }
+        before = lookaheadQ[w - 1].p();
     }
+    lookaheadQ.truncate(w);
 }
 
 
@@ -512,10 +989,16 @@ void Runner::optimizeLookaheadQueue() {
 Task *Runner::getNextTask() {
     if (prefaceIx < prefaceCount) {
         currentTaskCountsDistance = false;
-        return prefaceSequence[prefaceIx++];
+        return fixedTask_(prefaceSequence[prefaceIx++]);
     }
 
-    if (lookaheadQ.empty()) {
+    if (compiledJob) {
+        if (!eofReached) {
+            Task* t = nextCompiledTask_();
+            if (t) return t;
+        }
+    } else {
+        // Top up every task so the plan always sees the same horizon.
         fillLookaheadQueue();
     }
 
@@ -523,9 +1006,10 @@ Task *Runner::getNextTask() {
         const int finishingCount = 2;
         if (sequenceIx < finishingCount) {
             currentTaskCountsDistance = false;
-            return finishingSequence[sequenceIx++];
+            return fixedTask_(finishingSequence[sequenceIx++]);
         }
 
+        prefetch.stop();
         if (openedFile) openedFile.close();
         progress = 100;
         stopped = true;
@@ -538,8 +1022,16 @@ Task *Runner::getNextTask() {
 
     QueuedCommand cmd = lookaheadQ.front();
     lookaheadQ.pop_front();
+    if (plannedIx > 0) plannedIx--;
+    if (geomIx > 0) geomIx--;
+    if (optimizedIx > 0) optimizedIx--;
+    if (timedIx > 0) {
+        timedIx--;
+        timedS = lookaheadQ.empty() ? 0.0 : std::max(0.0, timedS - cmd.tNomS);
+    }
 
     if (cmd.type == QueuedCommand::Pen) {
+        planTail.fromRest = true;
         currentTaskCountsDistance = false;
         penIsDown = cmd.penDown;
         if (cmd.penDown != penIsDown) {
@@ -547,73 +1039,110 @@ Task *Runner::getNextTask() {
             penMovesTotal++;
             if (penIsDown) penMovesDown++; else penMovesUp++;
         }
-        return cmd.penDown ? (Task*)new PenTask(false, pen, penSettleMs) : (Task*)new PenTask(true, pen, penSettleMs);
-}
+        penTaskSlot.reset(!cmd.penDown, pen, penSettleMs);
+        return &penTaskSlot;
+    }
 
-    targetPosition = cmd.p;
+    targetPosition = cmd.p();
     currentTaskCountsDistance = true;
     currentMoveIsDrawing = penIsDown;
 
     // -------- Lookahead-based speed planning (task-level) --------
-    int baseSpeedSteps = penIsDown ? printSpeedSteps : moveSpeedSteps;
-    int plannedSpeedSteps = baseSpeedSteps;
-
-    try {
-        const auto cfg = movement->getPlannerConfig();
-
-        // Find next move point in lookaheadQ (skip pen commands)
-        Movement::Point nextMove;
-        bool hasNext = false;
-        for (const auto& c : lookaheadQ) {
-            if (c.type == QueuedCommand::Move) {
-                nextMove = c.p;
-                hasNext = true;
-                break;
-            }
+    // steps/s of the dominant motor, or mm/s in feed mode
+    const int baseSpeed = penIsDown ? printSpeedSteps : moveSpeedSteps;
+    double plannedSpeed = baseSpeed;
+    double entrySpeedMmS = -1.0;
+
+    if (cmd.hasBelt && cmd.lenMM > 1e-6) {
+        // Exit speed = entry of the following move (0 before a pen change / end of buffer).
+        double exitSpeedMmS = 0.0;
+        if (!lookaheadQ.empty() && lookaheadQ.front().type == QueuedCommand::Move) exitSpeedMmS = lookaheadQ.front().vEntry;
+
+        double cruiseMmS = cmd.vNom;
+        if (cmd.vCurve > 0.0f) cruiseMmS = std::min(cruiseMmS, (double)cmd.vCurve);
+        if (!movement->isStreaming()) {
+            // Each segment ramps on its own: cap by the trapezoid peak of this block.
+            const double vPeak = sqrt(cmd.accel * cmd.lenMM + 0.5 * (cmd.vEntry * cmd.vEntry + exitSpeedMmS * exitSpeedMmS));
+            cruiseMmS = std::min(cruiseMmS, vPeak);
         }
+        if (cruiseMmS < 1e-3) cruiseMmS = 1e-3;
 
-        const double dist = Movement::distanceBetweenPoints(startPosition, targetPosition);
-
-        if (hasNext && dist > 1e-6) {
-            const int maxDelta = movement->estimateMaxDeltaSteps(targetPosition.x, targetPosition.y);
-            if (maxDelta > 0) {
-                // Convert belt accel (steps/s^2) into mm/s^2 using mm per step.
-                const auto tuning = movement->getMotionTuning();
-                const double mmPerStep = stepsToMM(1);
-                const double accelMmS2 = std::max(1.0, (double)tuning.acceleration * mmPerStep);
-
-                // Nominal XY speed (mm/s) implied by the requested step rate.
-                const double vNomMmS = (dist * (double)baseSpeedSteps) / (double)maxDelta;
+        if (movement->isFeedMode()) {
+            plannedSpeed = std::min(cruiseMmS, (double)baseSpeed);
+        } else {
+            const int steps = (int)floor(cruiseMmS * (double)baseSpeed / cmd.vNom);
+            plannedSpeed = clampi(steps, 1, baseSpeed);
+        }
+        entrySpeedMmS = cmd.vEntry;
+    }
 
-                // Corner angle (0=straight).
-                const double angDeg = angleDegBetween(startPosition, targetPosition, nextMove);
-                const double theta = (angDeg * PI) / 180.0;
+    planTail.dx = cmd.p().x - planTail.p.x;
+    planTail.dy = cmd.p().y - planTail.p.y;
+    planTail.dL = (cmd.hasBelt && planTail.hasBelt) ? cmd.beltL - planTail.beltL : 0;
+    planTail.dR = (cmd.hasBelt && planTail.hasBelt) ? cmd.beltR - planTail.beltR : 0;
+    planTail.p = cmd.p();
+    planTail.hasBelt = cmd.hasBelt;
+    planTail.beltL = cmd.beltL;
+    planTail.beltR = cmd.beltR;
+    planTail.lenMM = cmd.lenMM;
+    planTail.vNom = cmd.vNom;
+    planTail.accel = cmd.accel;
+    planTail.vEntry = cmd.vEntry;
+    planTail.radiusMM = cmd.radiusMM;
+    planTail.fromRest = false;
+
+    moveTaskSlot.reset(movement, targetPosition, plannedSpeed, entrySpeedMmS, !penIsDown);
+    return &moveTaskSlot;
+}
 
-                // Angle-based slowdown (existing UI tuning).
-                const double sharpness = theta / PI; // 0..1
-                double f = 1.0 - sharpness * cfg.cornerSlowdown;
-                if (f < cfg.minCornerFactor) f = cfg.minCornerFactor;
-                if (f > 1.0) f = 1.0;
-                const double vAngleMmS = vNomMmS * f;
+// Next record of a compiled job; nullptr (and eofReached) at the end.
+Task* Runner::nextCompiledTask_() {
+    CommandReader::Command cmd;
+    while (reader.next(cmd)) {
+        if (cmd.kind == CommandReader::Command::Pen) {
+            currentTaskCountsDistance = false;
+            if (cmd.down != penIsDown) {
+                penIsDown = cmd.down;
+                penMovesTotal++;
+                if (penIsDown) penMovesDown++; else penMovesUp++;
+            }
+            penTaskSlot.reset(!cmd.down, pen, penSettleMs);
+            return &penTaskSlot;
+        }
+        if (cmd.kind != CommandReader::Command::Belt) continue;
 
-                // Physics-ish junction limit.
-                const double vJuncMmS = junctionSpeedMmS(theta, accelMmS2, cfg.junctionDeviationMM);
+        targetPosition = Movement::Point(cmd.x, cmd.y);
+        currentTaskCountsDistance = true;
+        currentMoveIsDrawing = penIsDown;
+        beltTaskSlot.reset(movement, targetPosition, cmd.beltL, cmd.beltR, cmd.vNom, cmd.vJunction);
+        return &beltTaskSlot;
+    }
+    eofReached = true;
+    return nullptr;
+}
 
-                double vPlannedMmS = vNomMmS;
-                vPlannedMmS = std::min(vPlannedMmS, vAngleMmS);
-                vPlannedMmS = std::min(vPlannedMmS, vJuncMmS);
+// Preface/finishing steps: pen changes and pen-up travel at move speed.
+Task* Runner::fixedTask_(const QueuedCommand& cmd) {
+    if (cmd.type == QueuedCommand::Pen) {
+        penTaskSlot.reset(!cmd.penDown, pen, penSettleMs);
+        return &penTaskSlot;
+    }
+    moveTaskSlot.reset(movement, cmd.p(), moveSpeedSteps, -1.0, true);
+    return &moveTaskSlot;
+}
 
-                if (vPlannedMmS < 1e-3) vPlannedMmS = 1e-3;
+bool Runner::startCurrentTask_() {
+    if (!currentTask) return false;
+    if (currentTaskStarted) return true;
 
-                const int steps = (int)floor((vPlannedMmS * (double)maxDelta) / dist);
-                plannedSpeedSteps = clampi(steps, 1, baseSpeedSteps);
-            }
-        }
-    } catch (...) {
-        plannedSpeedSteps = baseSpeedSteps;
-    }
+    // Movement tasks append to the step stream right away; everything else
+    // (pen) has to wait until the streamed motion has actually finished.
+    const bool streamed = currentTask->name() == InterpolatingMovementTask::NAME || currentTask->name() == BeltBlockTask::NAME;
+    if (!streamed && movement && movement->isMoving()) return false;
 
-    return new InterpolatingMovementTask(movement, targetPosition, plannedSpeedSteps);
+    currentTask->startRunning();
+    currentTaskStarted = true;
+    return true;
 }
 
 void Runner::run() {
@@ -628,18 +1157,18 @@ void Runner::run() {
         restartRequested = false;
         paused = false;
 
+        prefetch.stop();
         if (openedFile) openedFile.close();
         openedFile = File();
 
-        if (currentTask) {
-            delete currentTask;
-            currentTask = nullptr;
-        }
+        currentTask = nullptr;
 
         prefaceIx = 0;
         prefaceCount = 0;
         sequenceIx = 0;
         lookaheadQ.clear();
+        optimizedIx = 0;
+        pendingArc = PendingArc();
         eofReached = false;
 
         // reset metrics
@@ -655,11 +1184,12 @@ void Runner::run() {
         movingActiveMs = 0;
 
         setStartLine(restartLineAfterHeader);
-        initTaskProvider();
+        initTaskProvider(true);
 
         currentTask = getNextTask();
+        currentTaskStarted = false;
         if (currentTask) {
-            currentTask->startRunning();
+            startCurrentTask_();
             stopped = false;
         } else {
             stopped = true;
@@ -669,28 +1199,37 @@ void Runner::run() {
     }
 
     if (abortRequested) {
-        if (movement && movement->isMoving()) return;
+        if (movement && movement->isMoving()) {
+            movement->abortMotion();
+            return;
+        }
 
         abortRequested = false;
         paused = false;
 
+        prefetch.stop();
+        reader.begin(nullptr);   // drop what is buffered, nothing more comes from the file
+        compiledJob = false;
         if (openedFile) openedFile.close();
         openedFile = File();
 
-        if (currentTask) {
-            delete currentTask;
-            currentTask = nullptr;
-        }
+        currentTask = nullptr;
 
         prefaceIx = 0;
         prefaceCount = 0;
         sequenceIx = 0;
         lookaheadQ.clear();
-        eofReached = false;
+        optimizedIx = 0;
+        pendingArc = PendingArc();
+        eofReached = true;   // straight to the finishing sequence
+
+        finishingSequence[0] = QueuedCommand(false);
+        finishingSequence[1] = QueuedCommand(movement->getHomeCoordinates());
 
         currentTask = getNextTask();
+        currentTaskStarted = false;
         if (currentTask) {
-            currentTask->startRunning();
+            startCurrentTask_();
             stopped = false;
         } else {
             stopped = true;
@@ -700,9 +1239,11 @@ void Runner::run() {
 
     if (paused) return;
     if (!currentTask) { stopped = true; return; }
+    if (!startCurrentTask_()) return;
 
     if (currentTask->isDone()) {
-        if (currentTask->name() == InterpolatingMovementTask::NAME && currentTaskCountsDistance) {
+        const bool isMove = currentTask->name() == InterpolatingMovementTask::NAME || currentTask->name() == BeltBlockTask::NAME;
+        if (isMove && currentTaskCountsDistance) {
             const double distanceCovered = Movement::distanceBetweenPoints(startPosition, targetPosition);
             jobDistanceSoFar += distanceCovered;
             if (currentMoveIsDrawing) jobDrawDistanceSoFar += distanceCovered;
@@ -720,10 +1261,10 @@ void Runner::run() {
             }
         }
 
-        delete currentTask;
         currentTask = getNextTask();
+        currentTaskStarted = false;
 
-        if (currentTask) currentTask->startRunning();
+        if (currentTask) startCurrentTask_();
         else stopped = true;
     }
 }
@@ -734,7 +1275,6 @@ void Runner::dryRun() {
 
     Task* task = getNextTask();
     while (task != nullptr) {
-        delete task;
         task = getNextTask();
     }
 }
@@ -760,39 +1300,23 @@ void Runner::resumeJob() {
 }
 
 void Runner::abortAndGoHome() {
+    // Called from the web task while the loop may be inside the reader or a
+    // task: only flag it, run() tears the job down.
     abortRequested = true;
-
-    if (openedFile) {
-        openedFile.close();
-        openedFile = File();
-    }
-
-    if (currentTask) {
-        delete currentTask;
-        currentTask = nullptr;
-    }
-
-    prefaceIx = 0;
-    prefaceCount = 0;
-    sequenceIx = 0;
-    lookaheadQ.clear();
-    eofReached = false;
-
-    Movement::Point home = movement->getHomeCoordinates();
-    finishingSequence[0] = new PenTask(true, pen, penSettleMs);
-    finishingSequence[1] = new InterpolatingMovementTask(movement, home, moveSpeedSteps);
-
-    sequenceIx = 0;
-    stopped = false;
     paused = false;
-
-    currentTask = getNextTask();
-    if (currentTask) currentTask->startRunning();
+    stopped = false;
 
     WebLog::warn("Abort requested. Going home.");
 }
 
 void Runner::start() {
+    // held until stopped is cleared, so an index scan queued meanwhile sees the job
+    ReaderClaim claim(readerBusy);
+    if (!claim.held) {
+        WebLog::warn("Runner start: restart index build running");
+        return;
+    }
+
     paused = false;
     abortRequested = false;
 
@@ -805,14 +1329,12 @@ void Runner::start() {
 
     initTaskProvider();
 
-    if (currentTask) {
-        delete currentTask;
-        currentTask = nullptr;
-    }
+    currentTask = nullptr;
 
     currentTask = getNextTask();
+    currentTaskStarted = false;
     if (currentTask) {
-        currentTask->startRunning();
+        startCurrentTask_();
         stopped = false;
         WebLog::info("Runner started");
     } else {
@@ -870,6 +1392,20 @@ void Runner::tickTiming_() {
     }
 }
 
+bool Runner::buildCommandsIndex(CommandsIndexStats& stats) {
+    ReaderClaim claim(readerBusy);
+    if (!claim.held || !stopped) return false;
+    if (!sdCommandsEnsureMounted()) return false;
+    return commandsIndexBuild(prefetch, reader, stats);
+}
+
+bool Runner::convertCommands(CommandsConvertStats& stats) {
+    ReaderClaim claim(readerBusy);
+    if (!claim.held || !stopped) return false;
+    if (!sdCommandsEnsureMounted()) return false;
+    return convertCommandsToBinary(prefetch, reader, stats);
+}
+
 bool Runner::requestRestartFromLine(size_t lineAfterHeader) {
     // Allow while paused; robot will restart only when movement is idle.
     restartLineAfterHeader = lineAfterHeader;
@@ -2,33 +2,96 @@
 #define Runner_h
 
 #include <cstddef>
-#include <deque>
 #include <stdint.h>   // uint32_t
 #include <cstring>    // strcmp
+#include <atomic>
 #include <LittleFS.h>
 
 #include "movement.h"
 #include "tasks/task.h"
+#include "tasks/pentask.h"
+#include "tasks/interpolatingmovementtask.h"
+#include "tasks/beltblocktask.h"
+#include "ring_queue.h"
+#include "command_reader.h"
+#include "service/commands_index.h"
+#include "service/commands_converter.h"
 #include "pen.h"
 #include "display.h"
 
 class Runner {
 private:
+    // Compact record (the queue holds hundreds): float is plenty for mm on a
+    // wall a few meters wide and for the planned speeds.
     struct QueuedCommand {
-        enum Type { Pen, Move } type;
-        bool penDown;
-        Movement::Point p;
+        enum Type : uint8_t { Pen, Move } type;
+        bool penDown;            // Pen: new state; Move: state it was planned with
+
         bool protect;
+        bool hasBelt = false;
+        bool simplified = false; // passed the simplifier: fixed from now on
+        float x, y;              // mm
+
+        // Lookahead planner data (Move only), see planLookahead_().
+        int beltL = 0;
+        int beltR = 0;
+        float lenMM = 0.0f;
+        float vNom = 0.0f;       // mm/s
+        float accel = 0.0f;      // mm/s^2
+        float decel = 0.0f;      // mm/s^2, braking
+        float vJunction = 0.0f;  // max entry speed, mm/s
+        float vEntry = 0.0f;     // planned entry speed, mm/s
+        float radiusMM = 0.0f;   // arc radius from G2/G3 (0 = polyline point)
+        float vCurve = 0.0f;     // curvature speed cap over the block, mm/s (0 = none)
+        float tNomS = 0.0f;      // share of timedS (see timeQueue_())
+
+        QueuedCommand() : QueuedCommand(false) {}
+        QueuedCommand(bool down) : type(Pen), penDown(down), protect(false), x(0.0f), y(0.0f) {}
+        QueuedCommand(Movement::Point pt, bool protect = false)
+            : type(Move), penDown(false), protect(protect), x((float)pt.x), y((float)pt.y) {}
+
+        Movement::Point p() const { return Movement::Point(x, y); }
+    };
 
-        QueuedCommand(bool down) : type(Pen), penDown(down), p(0, 0), protect(false) {}
-        QueuedCommand(Movement::Point pt, bool protect = false) : type(Move), penDown(false), p(pt), protect(protect) {}
+    // Queue depth: the fill stops at LOOKAHEAD_MAX entries, the rest is room
+    // for corner fillets and one G2/G3 line in flight.
+    static constexpr size_t LOOKAHEAD_MAX = 512;
+    static constexpr size_t LOOKAHEAD_CAPACITY = 768;
+
+    // G2/G3 line being expanded into the queue as space allows.
+    struct PendingArc {
+        bool active = false;
+        double cx = 0.0, cy = 0.0, radius = 0.0;
+        double a0 = 0.0, sweep = 0.0;
+        Movement::Point end;   // the G2/G3 target, where the next line starts
+        int n = 0;
+        int k = 0;
+    };
+
+    // Last block handed to a task; the plan continues from it.
+    struct PlannedTail {
+        Movement::Point p;
+        bool hasBelt = false;
+        int beltL = 0;
+        int beltR = 0;
+        KinScalar dx = 0;
+        KinScalar dy = 0;
+        int dL = 0;             // belt steps of the last block
+        int dR = 0;
+        KinScalar lenMM = 0;
+        KinScalar vNom = 0;
+        KinScalar accel = 0;
+        KinScalar vEntry = 0;
+        KinScalar radiusMM = 0;
+        bool fromRest = true;   // start of job or pen change: next block enters at 0
     };
 
     Movement *movement;
     Pen *pen;
     Display *display;
 
-    void initTaskProvider();
+    // mayBuildIndex: build a missing restart index (loop only, it scans the file)
+    void initTaskProvider(bool mayBuildIndex = false);
     Task* getNextTask();
 
     // Timing / stats helpers (used by HUD + diagnostics)
@@ -43,11 +106,40 @@ private:
     bool parked = false;
 
     bool fillLookaheadQueue();
-    void optimizeLookaheadQueue();
+    size_t optimizeLookaheadQueue();
+    void stateBefore_(size_t i, Movement::Point& pos, bool& penDown, bool& moveBefore) const;
+    void blendCorners_(size_t from, double maxDeviationMM);
+    void simplifyLookaheadQueue_(size_t from, double toleranceMM);
+    size_t optimizedIx = 0;   // entries before it went through optimizeLookaheadQueue()
+
+    // GRBL-style planner over lookaheadQ: reverse pass (stop at the end of the
+    // buffer), forward pass (acceleration limited). Entries [0, plannedIx) are
+    // optimal already and are not recomputed when new blocks are appended;
+    // entries [0, geomIx) keep their block geometry (length, limits).
+    void resetPlanner_(const Movement::Point& from);
+    void planLookahead_();
+    PlannedTail planTail;
+    size_t plannedIx = 0;
+    size_t geomIx = 0;
+    int geomPrintSpeed = 0;   // speeds the cached geometry was computed with
+    int geomMoveSpeed = 0;
+
+    // Queued motion time at nominal speed over lookaheadQ[0, timedIx), a lower
+    // bound (planning only slows moves down). Kept across top-ups: new entries
+    // are added, popped and rewritten ones are taken out again.
+    void timeQueue_();
+    void untimeFrom_(size_t from);
+    double timedS = 0.0;
+    size_t timedIx = 0;
+    Movement::Point timedPos;
+    bool timedDown = false;
 
     Task* currentTask = nullptr;
+    bool currentTaskStarted = false;
     bool currentTaskCountsDistance = false;
 
+    bool startCurrentTask_();
+
     bool currentMoveIsDrawing = false;
 
     bool stopped = true;
@@ -55,17 +147,31 @@ private:
 
     size_t startLine = 0;
 
-    Task* prefaceSequence[3];
+    // Preface/finishing steps are kept as commands; every task the runner hands
+    // out is one of the two slots below, reset in place instead of allocated.
+    QueuedCommand prefaceSequence[3];
     int   prefaceIx    = 0;
     int   prefaceCount = 0;
 
-    Task* finishingSequence[2];
+    QueuedCommand finishingSequence[2];
     int   sequenceIx   = 0;
 
+    PenTask penTaskSlot;
+    InterpolatingMovementTask moveTaskSlot;
+    BeltBlockTask beltTaskSlot;
+    Task* fixedTask_(const QueuedCommand& cmd);
+
     File openedFile;
+    SdPrefetch prefetch;      // reads openedFile ahead on its own task
+    CommandReader reader;     // buffered lines of openedFile
 
     double headerTotalDistance = 0.0;
 
+    // Compiled job (command_format.h): the records go to the stream as they
+    // are, no lookahead queue.
+    bool compiledJob = false;
+    Task* nextCompiledTask_();
+
     double jobTotalDistance = 0.0;
     double jobDistanceSoFar = 0.0;
 
@@ -81,7 +187,9 @@ private:
 
     volatile bool abortRequested = false;
 
-    std::deque<QueuedCommand> lookaheadQ;
+    RingQueue<QueuedCommand, LOOKAHEAD_CAPACITY> lookaheadQ;
+    PendingArc pendingArc;
+    bool drainArc_();
     bool eofReached = false;
 
     bool penIsDown = false;
@@ -92,9 +200,6 @@ private:
     bool pendingPenUp = false;
     bool pendingPenUpPrevDown = false;
 
-    String pushbackLine;
-    bool hasPushbackLine = false;
-
     // Pen move counters (count only real toggles)
     uint32_t penMovesTotal = 0;
     uint32_t penMovesUp    = 0;
@@ -103,6 +208,8 @@ private:
     bool restartRequested = false;
     size_t restartLineAfterHeader = 0;
 
+    std::atomic<bool> readerBusy{false};   // start() or a file scan owns prefetch/reader
+
 public:
     Runner(Movement *movement, Pen *pen, Display *display);
 
@@ -116,6 +223,13 @@ public:
     uint32_t getPenMovesUp() const;
     uint32_t getPenMovesDown() const;
 
+    // SD prefetch: blocks kept ahead, ready now, reads the parser waited for,
+    // slowest single block read
+    int getSdPrefetchDepth() const;
+    int getSdPrefetchReady() const;
+    uint32_t getSdPrefetchStalls() const;
+    uint32_t getSdWorstReadUs() const;
+
     void setStartLine(size_t lineAfterHeader);
     size_t getStartLine() const;
 
@@ -128,6 +242,14 @@ public:
 
     bool requestRestartFromLine(size_t lineAfterHeader);
 
+    // Restart index of /commands (service/commands_index.h); built on the
+    // first deep restart otherwise. Only while stopped, called from loop().
+    bool buildCommandsIndex(CommandsIndexStats& stats);
+
+    // Text /commands -> binary (service/commands_converter.h), with the same
+    // reader and preconditions as buildCommandsIndex().
+    bool convertCommands(CommandsConvertStats& stats);
+
     void abortAndGoHome();
 
     int getProgress() const;
@@ -0,0 +1,101 @@
+#include "sd_prefetch.h"
+
+// Same core as WiFi, below the loop: the task sleeps on the SPI transfer most
+// of the time and only needs to stay ahead of the parser.
+static constexpr BaseType_t PREFETCH_CORE = 0;
+static constexpr UBaseType_t PREFETCH_PRIORITY = 1;
+static constexpr uint32_t PREFETCH_STACK = 3072;
+
+bool SdPrefetch::start(File* f) {
+  if (!io) io = xSemaphoreCreateMutex();
+  if (!filled) filled = xSemaphoreCreateBinary();
+  if (!io || !filled) return false;
+
+  if (!task) {
+    if (xTaskCreatePinnedToCore(&SdPrefetch::taskEntry_, "sdPrefetch", PREFETCH_STACK, this,
+                                PREFETCH_PRIORITY, &task, PREFETCH_CORE) != pdPASS) {
+      task = nullptr;
+      return false;
+    }
+  }
+
+  stop();
+  file = f;
+  fileEnd = (f == nullptr);
+  running = true;
+  xTaskNotifyGive(task);
+  return true;
+}
+
+void SdPrefetch::stop() {
+  running = false;
+  if (!io) return;
+
+  xSemaphoreTake(io, portMAX_DELAY);
+  file = nullptr;
+  produced = 0;
+  consumed = 0;
+  fileEnd = true;
+  xSemaphoreGive(io);
+}
+
+size_t SdPrefetch::read(uint8_t* dst) {
+  bool stalled = false;
+  for (;;) {
+    const uint32_t c = consumed.load();
+    if (produced.load() != c) {
+      const Slot& s = slots[c % SLOTS];
+      const size_t n = s.len;
+      memcpy(dst, s.data, n);
+      consumed = c + 1;
+      xTaskNotifyGive(task);
+      return n;
+    }
+    if (fileEnd || !running) {
+      // the last block may have landed between the two loads
+      if (produced.load() != c) continue;
+      return 0;
+    }
+
+    if (!stalled) {
+      stalled = true;
+      stallCount++;
+    }
+    xSemaphoreTake(filled, pdMS_TO_TICKS(50));
+  }
+}
+
+void SdPrefetch::taskEntry_(void* arg) {
+  static_cast<SdPrefetch*>(arg)->taskLoop_();
+}
+
+void SdPrefetch::taskLoop_() {
+  for (;;) {
+    if (!running || fileEnd || produced.load() - consumed.load() >= (uint32_t)SLOTS) {
+      // woken by start() and by every block taken
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+
+    xSemaphoreTake(io, portMAX_DELAY);
+    // stop() may have run since the check above
+    if (running && !fileEnd && file) {
+      const uint32_t p = produced.load();
+      Slot& s = slots[p % SLOTS];
+
+      const uint32_t t0 = micros();
+      const size_t got = file->read(s.data, BLOCK);
+      const uint32_t dt = micros() - t0;
+      if (dt > worstUs) worstUs = dt;
+
+      if (got == 0 || got > BLOCK) {
+        fileEnd = true;
+      } else {
+        s.len = got;
+        produced = p + 1;
+      }
+    }
+    xSemaphoreGive(io);
+    xSemaphoreGive(filled);
+  }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <atomic>
+
+// Reads the running job ahead of the parser on its own FreeRTOS task, so a
+// slow SD read (card busy, FAT chain walk) is absorbed by the buffered blocks
+// instead of stalling the loop that plans and feeds the motion.
+//
+// One producer (the task) and one consumer (the Runner) share a ring of
+// SLOTS blocks; the file is only touched by the task while a job is open.
+class SdPrefetch {
+public:
+  static constexpr size_t BLOCK = 2048;   // 4 SD sectors per read
+  static constexpr int SLOTS = 4;
+
+  // Start reading `file` from its current position (the task is created on
+  // first use). The file must stay open until stop().
+  bool start(File* file);
+
+  // Wait for a read in flight and drop the buffered blocks; the file can be
+  // closed afterwards.
+  void stop();
+
+  // Copy the next block to dst (BLOCK bytes of room); waits if none is ready.
+  // Returns 0 at the end of the file.
+  size_t read(uint8_t* dst);
+
+  // Diagnostics
+  int depth() const { return SLOTS; }
+  int ready() const { return (int)(produced.load() - consumed.load()); }
+  uint32_t stalls() const { return stallCount; }
+  uint32_t worstReadUs() const { return worstUs; }
+
+private:
+  static void taskEntry_(void* arg);
+  void taskLoop_();
+
+  struct Slot {
+    uint8_t data[BLOCK];
+    size_t len = 0;
+  };
+  Slot slots[SLOTS];
+
+  File* file = nullptr;
+  std::atomic<uint32_t> produced{0};
+  std::atomic<uint32_t> consumed{0};
+  std::atomic<bool> running{false};
+  std::atomic<bool> fileEnd{false};
+
+  TaskHandle_t task = nullptr;
+  SemaphoreHandle_t io = nullptr;       // held by the task around each SD read
+  SemaphoreHandle_t filled = nullptr;   // given after each block
+
+  volatile uint32_t stallCount = 0;
+  volatile uint32_t worstUs = 0;
+};
@@ -0,0 +1,213 @@
+#include "commands_converter.h"
+#include "command_format.h"
+#include "command_reader.h"
+#include "commands_index.h"
+#include <SD.h>
+
+namespace {
+
+// /commands.txt is only the text of the binary /commands it was converted
+// to; this sidecar holds that binary's size and hash (commandsFileHash()).
+const char *TEXT_SOURCE_PATH = "/commands.txt.src";
+
+struct TextSource {
+  uint32_t size = 0;
+  uint32_t hash = 0;
+};
+
+bool readSignature(TextSource &out) {
+  File f = SD.open("/commands", FILE_READ);
+  if (!f) return false;
+  out.size = (uint32_t)f.size();
+  out.hash = commandsFileHash(f);
+  f.close();
+  return true;
+}
+
+bool textCopyMatches() {
+  File f = SD.open(TEXT_SOURCE_PATH, FILE_READ);
+  if (!f) return false;
+  TextSource stored;
+  const bool got = f.read((uint8_t *)&stored, sizeof(stored)) == sizeof(stored);
+  f.close();
+
+  TextSource now;
+  return got && readSignature(now) && now.size == stored.size && now.hash == stored.hash;
+}
+
+void writeTextSource() {
+  SD.remove(TEXT_SOURCE_PATH);
+  TextSource sig;
+  if (!readSignature(sig)) return;
+  File f = SD.open(TEXT_SOURCE_PATH, FILE_WRITE);
+  if (!f) return;
+  f.write((const uint8_t *)&sig, sizeof(sig));
+  f.close();
+}
+
+// Small write buffer: the SD library writes sector-sized chunks best.
+struct RecordWriter {
+  File &out;
+  uint8_t buf[512];
+  size_t n = 0;
+  uint32_t written = 0;
+  bool ok = true;
+
+  explicit RecordWriter(File &f) : out(f) {}
+
+  void put(const uint8_t *p, size_t len) {
+    if (n + len > sizeof(buf)) flush();
+    memcpy(buf + n, p, len);
+    n += len;
+  }
+
+  void flush() {
+    if (n == 0) return;
+    if (out.write(buf, n) != n) ok = false;
+    written += n;
+    n = 0;
+  }
+};
+
+}  // namespace
+
+bool commandsFileIsBinary() {
+  File f = SD.open("/commands", FILE_READ);
+  if (!f) return false;
+  uint8_t magic[4] = {0, 0, 0, 0};
+  const size_t got = f.read(magic, sizeof(magic));
+  f.close();
+  return cmdbin::isBinary(magic, got) || cmdbin::isCompiled(magic, got);
+}
+
+String commandsTextPath() {
+  if (!SD.exists("/commands")) return String();
+  if (!commandsFileIsBinary()) return String("/commands");
+  // a later upload replaced /commands: the text copy is another job
+  return (SD.exists("/commands.txt") && textCopyMatches()) ? String("/commands.txt") : String();
+}
+
+bool convertCommandsToBinary(SdPrefetch &prefetch, CommandReader &reader, CommandsConvertStats &stats) {
+  stats = CommandsConvertStats();
+
+  if (!SD.exists("/commands")) return false;
+  if (commandsFileIsBinary()) { stats.alreadyBinary = true; return true; }
+
+  if (SD.exists("/commands.tmp")) SD.remove("/commands.tmp");
+  File in = SD.open("/commands", FILE_READ);
+  if (!in) return false;
+  stats.inBytes = (uint32_t)in.size();
+
+  if (!prefetch.start(&in)) { in.close(); return false; }
+  reader.begin(&prefetch);
+
+  auto closeInput = [&]() {
+    prefetch.stop();
+    reader.begin(nullptr);
+    in.close();
+  };
+
+  double total = 0.0, height = 0.0;
+  if (!reader.readHeader(total, height) || reader.isBinary() || reader.isCompiled()) {
+    closeInput();
+    return false;
+  }
+
+  File out = SD.open("/commands.tmp", FILE_WRITE);
+  if (!out) { closeInput(); return false; }
+
+  cmdbin::Header header;
+  header.totalDistance = cmdbin::toUnits(total);
+  header.height = cmdbin::toUnits(height);
+
+  // placeholder, rewritten with the totals at the end
+  uint8_t head[cmdbin::HEADER_SIZE];
+  cmdbin::encodeHeader(header, head);
+  RecordWriter w(out);
+  w.put(head, sizeof(head));
+
+  bool havePoint = false;
+  int32_t curX = 0, curY = 0;
+  uint32_t loopCounter = 0;
+
+  CommandReader::Command cmd;
+  while (w.ok && reader.next(cmd)) {
+    // Avoid WDT resets on large files
+    if ((++loopCounter & 0x3FF) == 0) { delay(0); }
+
+    uint8_t rec[cmdbin::MAX_RECORD];
+    size_t n = 0;
+    switch (cmd.kind) {
+      case CommandReader::Command::Pen:
+        rec[n++] = cmd.down ? cmdbin::OP_PEN_DOWN : cmdbin::OP_PEN_UP;
+        break;
+
+      case CommandReader::Command::Move:
+      case CommandReader::Command::Arc: {
+        const int32_t x = cmdbin::toUnits(cmd.x);
+        const int32_t y = cmdbin::toUnits(cmd.y);
+        if (cmd.kind == CommandReader::Command::Move) {
+          rec[n++] = cmdbin::OP_MOVE;
+        } else {
+          rec[n++] = cmd.cw ? cmdbin::OP_ARC_CW : cmdbin::OP_ARC_CCW;
+        }
+        n += cmdbin::putVarint(rec + n, x - curX);
+        n += cmdbin::putVarint(rec + n, y - curY);
+        if (cmd.kind == CommandReader::Command::Arc) {
+          n += cmdbin::putVarint(rec + n, cmdbin::toUnits(cmd.i));
+          n += cmdbin::putVarint(rec + n, cmdbin::toUnits(cmd.j));
+        }
+        curX = x;
+        curY = y;
+
+        if (!havePoint) {
+          header.minX = header.maxX = x;
+          header.minY = header.maxY = y;
+          havePoint = true;
+        } else {
+          if (x < header.minX) header.minX = x;
+          if (x > header.maxX) header.maxX = x;
+          if (y < header.minY) header.minY = y;
+          if (y > header.maxY) header.maxY = y;
+        }
+        break;
+      }
+
+      default:
+        stats.skippedLines++;
+        continue;
+    }
+
+    w.put(rec, n);
+    header.count++;
+  }
+  w.flush();
+
+  cmdbin::encodeHeader(header, head);
+  const bool headerOk = out.seek(0) && out.write(head, sizeof(head)) == sizeof(head);
+
+  closeInput();
+  out.close();
+
+  if (!w.ok || !headerOk) {
+    SD.remove("/commands.tmp");
+    return false;
+  }
+  stats.commands = header.count;
+  stats.outBytes = w.written;
+
+  // Keep the text for the web UI, binary becomes /commands
+  SD.remove("/commands.txt");
+  if (!SD.rename("/commands", "/commands.txt")) {
+    SD.remove("/commands.tmp");
+    return false;
+  }
+  if (!SD.rename("/commands.tmp", "/commands")) {
+    // rollback best-effort
+    SD.remove("/commands.tmp");
+    SD.rename("/commands.txt", "/commands");
+    return false;
+  }
+  writeTextSource();
+  return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <Arduino.h>
+
+class SdPrefetch;
+class CommandReader;
+
+struct CommandsConvertStats {
+  bool alreadyBinary = false;
+  uint32_t commands = 0;       // records written
+  uint32_t skippedLines = 0;   // text lines that are no command
+  uint32_t inBytes = 0;
+  uint32_t outBytes = 0;
+};
+
+// Rewrites a text /commands as the binary format (command_format.h), parsing
+// with the given (idle) prefetch and reader; see Runner::convertCommands().
+// The text is kept as /commands.txt for the web UI (see commandsTextPath()).
+bool convertCommandsToBinary(SdPrefetch &prefetch, CommandReader &reader, CommandsConvertStats &stats);
+
+// True if /commands starts with the binary or the compiled magic.
+bool commandsFileIsBinary();
+
+// Text form of the job for download: /commands, or /commands.txt next to a
+// binary one it was converted to (a binary uploaded later has none). Empty if
+// there is none.
+String commandsTextPath();
@@ -0,0 +1,170 @@
+#include "commands_index.h"
+#include "command_reader.h"
+#include "command_format.h"
+#include "movement.h"
+#include <SD.h>
+
+namespace {
+
+const char *INDEX_PATH = "/commands.idx";
+const char *INDEX_TMP_PATH = "/commands.idx.tmp";
+
+struct IndexHeader {
+  char magic[4] = {'V', 'P', 'I', '1'};
+  uint32_t entrySize = sizeof(CommandsIndexEntry);
+  uint32_t interval = COMMANDS_INDEX_INTERVAL;
+  uint32_t fileSize = 0;
+  uint32_t fileHash = 0;
+  uint32_t entries = 0;
+  double firstX = 0.0;
+  double firstY = 0.0;
+};
+
+}  // namespace
+
+uint32_t commandsFileHash(File &f) {
+  uint8_t buf[512];
+  uint32_t h = 2166136261u;
+  auto mix = [&](size_t n) {
+    for (size_t i = 0; i < n; i++) { h ^= buf[i]; h *= 16777619u; }
+  };
+
+  const uint32_t size = (uint32_t)f.size();
+  f.seek(0);
+  mix(f.read(buf, sizeof(buf)));
+  if (size > sizeof(buf)) {
+    f.seek(size - sizeof(buf));
+    mix(f.read(buf, sizeof(buf)));
+  }
+  return h;
+}
+
+namespace {
+
+bool headerMatches(const IndexHeader &h, File &commands) {
+  const IndexHeader expected;
+  return memcmp(h.magic, expected.magic, 4) == 0 && h.entrySize == expected.entrySize &&
+         h.interval == expected.interval && h.entries > 0 && h.fileSize == (uint32_t)commands.size() &&
+         h.fileHash == commandsFileHash(commands);
+}
+
+}  // namespace
+
+bool commandsIndexBuild(SdPrefetch &prefetch, CommandReader &reader, CommandsIndexStats &stats) {
+  stats = CommandsIndexStats();
+  const uint32_t t0 = millis();
+
+  File in = SD.open("/commands", FILE_READ);
+  if (!in) return false;
+
+  IndexHeader header;
+  header.fileSize = (uint32_t)in.size();
+  header.fileHash = commandsFileHash(in);
+  in.seek(0);
+
+  if (!prefetch.start(&in)) { in.close(); return false; }
+  reader.begin(&prefetch);
+
+  double total = 0.0, height = 0.0;
+  if (!reader.readHeader(total, height)) {
+    prefetch.stop();
+    in.close();
+    return false;
+  }
+
+  if (SD.exists(INDEX_TMP_PATH)) SD.remove(INDEX_TMP_PATH);
+  File out = SD.open(INDEX_TMP_PATH, FILE_WRITE);
+  if (!out) {
+    prefetch.stop();
+    in.close();
+    return false;
+  }
+  bool ok = out.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+
+  // Same bookkeeping as the skip in Runner::initTaskProvider(). A compiled job
+  // starts at its header point, the others at the first move.
+  CommandsIndexEntry state;
+  if (reader.isCompiled()) {
+    const cmdbin::CompiledHeader &ch = reader.compiledHeader();
+    state.x = header.firstX = cmdbin::toMM(ch.startX);
+    state.y = header.firstY = cmdbin::toMM(ch.startY);
+    state.beltL = ch.startL;
+    state.beltR = ch.startR;
+    state.hasPoint = 1;
+  }
+
+  uint32_t consumed = 0;
+  CommandReader::Command cmd;
+  for (;;) {
+    if (consumed % COMMANDS_INDEX_INTERVAL == 0) {
+      state.offset = reader.offset();
+      state.line = consumed;
+      if (out.write((const uint8_t *)&state, sizeof(state)) != sizeof(state)) ok = false;
+      header.entries++;
+      // Avoid WDT resets on large files
+      delay(0);
+    }
+    if (!ok || !reader.next(cmd)) break;
+    consumed++;
+
+    if (cmd.kind == CommandReader::Command::Pen) {
+      state.penDown = cmd.down ? 1 : 0;
+      continue;
+    }
+    if (cmd.kind == CommandReader::Command::Other) continue;
+
+    if (cmd.kind == CommandReader::Command::Belt) {
+      state.beltL = (int32_t)cmd.beltL;
+      state.beltR = (int32_t)cmd.beltR;
+    }
+    if (state.hasPoint) {
+      state.distance += Movement::distanceBetweenPoints(Movement::Point(state.x, state.y), Movement::Point(cmd.x, cmd.y));
+    } else {
+      header.firstX = cmd.x;
+      header.firstY = cmd.y;
+      state.hasPoint = 1;
+    }
+    state.x = cmd.x;
+    state.y = cmd.y;
+  }
+  prefetch.stop();
+  reader.begin(nullptr);
+  in.close();
+
+  ok = ok && out.seek(0) && out.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+  out.close();
+
+  if (!ok) {
+    SD.remove(INDEX_TMP_PATH);
+    return false;
+  }
+  if (SD.exists(INDEX_PATH)) SD.remove(INDEX_PATH);
+  if (!SD.rename(INDEX_TMP_PATH, INDEX_PATH)) {
+    SD.remove(INDEX_TMP_PATH);
+    return false;
+  }
+
+  stats.commands = consumed;
+  stats.entries = header.entries;
+  stats.buildMs = millis() - t0;
+  return true;
+}
+
+bool commandsIndexLookup(File &commands, uint32_t line, CommandsIndexEntry &out, double &firstX, double &firstY) {
+  File idx = SD.open(INDEX_PATH, FILE_READ);
+  if (!idx) return false;
+
+  IndexHeader h;
+  bool ok = idx.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && headerMatches(h, commands);
+  if (ok) {
+    uint32_t k = line / h.interval;
+    if (k >= h.entries) k = h.entries - 1;
+    ok = idx.seek(sizeof(h) + k * sizeof(CommandsIndexEntry)) &&
+         idx.read((uint8_t *)&out, sizeof(out)) == sizeof(out) && out.line <= line;
+  }
+  idx.close();
+
+  firstX = h.firstX;
+  firstY = h.firstY;
+  return ok;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+
+class SdPrefetch;
+class CommandReader;
+
+// Sidecar index of /commands (/commands.idx) for restarts deep into a job.
+// Every COMMANDS_INDEX_INTERVAL commands it stores the file offset and the
+// state the Runner would have after skipping up to there, so a restart seeks
+// instead of parsing the file from the top. It carries the size and a hash
+// of /commands and is ignored (and rebuilt) once they no longer match.
+
+static constexpr uint32_t COMMANDS_INDEX_INTERVAL = 256;
+
+struct CommandsIndexEntry {
+  uint32_t offset = 0;            // file offset of command `line`
+  uint32_t line = 0;              // commands after the header before it
+  double distance = 0.0;          // path skipped from the first point, mm
+  double x = 0.0, y = 0.0;        // point before it, mm (0 while hasPoint is 0)
+  int32_t beltL = 0, beltR = 0;   // compiled job: belt steps before it
+  uint8_t penDown = 0;
+  uint8_t hasPoint = 0;           // a move came before it
+  uint8_t reserved[6] = {0, 0, 0, 0, 0, 0};
+};
+
+struct CommandsIndexStats {
+  uint32_t commands = 0;
+  uint32_t entries = 0;
+  uint32_t buildMs = 0;
+};
+
+// Scans /commands and writes /commands.idx, reading with the given (idle)
+// prefetch and reader; see Runner::buildCommandsIndex().
+bool commandsIndexBuild(SdPrefetch &prefetch, CommandReader &reader, CommandsIndexStats &stats);
+
+// FNV-1a over the first and the last 512 bytes of f (read position changes).
+// With the size it tells an uploaded job from the one a sidecar was made for.
+uint32_t commandsFileHash(File &f);
+
+// Last entry at or before `line` for the open /commands `commands` (its read
+// position is changed). firstX/firstY: the first point of the job, distances
+// count from there. False if there is no index or it is stale.
+bool commandsIndexLookup(File &commands, uint32_t line, CommandsIndexEntry &out, double &firstX, double &firstY);
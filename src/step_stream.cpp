@@ -0,0 +1,457 @@
+#include "step_stream.h"
+
+#include <math.h>
+#include <algorithm>
+
+// Lowest speed used while approaching a full stop, so a block always completes.
+static constexpr double V_FLOOR_MM_S = 0.2;
+
+StepStream::StepStream(StepperBackend* left, StepperBackend* right) {
+    this->left = left;
+    this->right = right;
+}
+
+bool StepStream::isSupported() const {
+    return left && right && left->supportsStreaming() && right->supportsStreaming();
+}
+
+bool StepStream::isActive() const {
+    if (count > 0 || settleSlices > 0) return true;
+    return left->streamBusy() || right->streamBusy();
+}
+
+double StepStream::tailLeft() const {
+    if (count > 0) return at(count - 1).endL;
+    if (isActive()) return rawL;
+    return (double)left->currentPosition();
+}
+
+double StepStream::tailRight() const {
+    if (count > 0) return at(count - 1).endR;
+    if (isActive()) return rawR;
+    return (double)right->currentPosition();
+}
+
+double StepStream::reachableSpeed(double v0, double d, double accel, double jerk) {
+    if (!(d > 0.0)) return v0;
+    if (!(jerk > 0.0)) return sqrt(v0 * v0 + 2.0 * accel * d);
+
+    // A speed change dv takes T = dv/A + A/J with a constant-acceleration
+    // phase (dv >= A^2/J), else T = 2*sqrt(dv/J); the distance is (v0 + dv/2) * T.
+    const double dvFull = accel * accel / jerk;
+    const double dFull = (v0 + 0.5 * dvFull) * (2.0 * accel / jerk);
+
+    double dv;
+    if (d >= dFull) {
+        const double qa = 0.5 / accel;
+        const double qb = v0 / accel + 0.5 * accel / jerk;
+        const double qc = v0 * accel / jerk - d;
+        dv = (-qb + sqrt(qb * qb - 4.0 * qa * qc)) / (2.0 * qa);
+    } else {
+        // u = sqrt(dv): u^3 + 2*v0*u - d*sqrt(J) = 0, one real root
+        const double p = 2.0 * v0;
+        const double q = d * sqrt(jerk);
+        const double disc = sqrt(0.25 * q * q + p * p * p / 27.0);
+        double u = cbrt(0.5 * q + disc) + cbrt(0.5 * q - disc);
+        // Cardano cancels badly when v0 dominates; polish with Newton
+        for (int i = 0; i < 2; i++) u -= (u * u * u + p * u - q) / (3.0 * u * u + p);
+        dv = u * u;
+    }
+    return v0 + std::max(0.0, dv);
+}
+
+void StepStream::setShaper(Shaper type, double freqHz) {
+    shaperType = type;
+    shaperHz = freqHz;
+}
+
+void StepStream::resetShaper(double posL, double posR) {
+    activeShaper = shaperType;
+    activeHz = 0.0;
+    impulses = 0;
+    settleSlices = 0;
+    for (int i = 0; i < HISTORY; i++) {
+        histL[i] = posL;
+        histR[i] = posR;
+    }
+    histPos = 0;
+    if (activeShaper != Shaper::None) updateShaper(shaperHz);
+}
+
+void StepStream::updateShaper(double freqHz) {
+    // the longest impulse delay (one damped period) has to fit the history
+    const double wd = sqrt(1.0 - SHAPER_DAMPING * SHAPER_DAMPING);
+    const double sliceS = (double)SLICE_US * 1e-6;
+    const double minHz = 1.0 / (wd * (HISTORY - 2) * sliceS);
+    if (!(freqHz >= minHz)) freqHz = minHz;
+    if (impulses > 0 && fabs(freqHz - activeHz) < 0.02 * activeHz) return;
+    activeHz = freqHz;
+
+    const double K = exp(-SHAPER_DAMPING * PI / wd);
+    const double half = 0.5 / (freqHz * wd) / sliceS;
+    switch (activeShaper) {
+    case Shaper::ZV:
+        impulses = 2;
+        impA[0] = 1.0;  impA[1] = K;
+        break;
+    case Shaper::ZVD:
+        impulses = 3;
+        impA[0] = 1.0;  impA[1] = 2.0 * K;  impA[2] = K * K;
+        break;
+    case Shaper::EI: {
+        constexpr double vTol = 0.05;  // residual vibration at the design frequency
+        impulses = 3;
+        impA[0] = 0.25 * (1.0 + vTol);
+        impA[1] = 0.5 * (1.0 - vTol) * K;
+        impA[2] = 0.25 * (1.0 + vTol) * K * K;
+        break;
+    }
+    default:
+        impulses = 1;
+        impA[0] = 1.0;
+        break;
+    }
+
+    double sum = 0.0;
+    for (int i = 0; i < impulses; i++) sum += impA[i];
+    for (int i = 0; i < impulses; i++) {
+        impA[i] /= sum;
+        impDelay[i] = half * i;
+    }
+}
+
+void StepStream::shape(double& posL, double& posR) {
+    histPos = (histPos + 1) % HISTORY;
+    histL[histPos] = posL;
+    histR[histPos] = posR;
+    if (impulses <= 1) return;
+
+    double outL = 0.0, outR = 0.0;
+    for (int i = 0; i < impulses; i++) {
+        const int m = (int)impDelay[i];
+        const double f = impDelay[i] - m;
+        const int i0 = (histPos - m + HISTORY) % HISTORY;
+        const int i1 = (i0 - 1 + HISTORY) % HISTORY;
+        outL += impA[i] * (histL[i0] + (histL[i1] - histL[i0]) * f);
+        outR += impA[i] * (histR[i0] + (histR[i1] - histR[i0]) * f);
+    }
+    posL = outL;
+    posR = outR;
+}
+
+uint32_t StepStream::getBackendErrors() const {
+    return left->streamErrors() + right->streamErrors();
+}
+
+bool StepStream::push(const Block& block) {
+    if (isFull()) return false;
+
+    Block b = block;
+    if (b.lenMM < 1e-6) b.lenMM = 1e-6;
+    if (b.vNom < V_FLOOR_MM_S) b.vNom = V_FLOOR_MM_S;
+    if (b.accel < 1e-3) b.accel = 1e-3;
+    if (b.decel < 1e-3) b.decel = 1e-3;
+
+    if (count == 0) {
+        if (!isActive()) {
+            emittedL = left->currentPosition();
+            emittedR = right->currentPosition();
+            rawL = (double)emittedL;
+            rawR = (double)emittedR;
+            resetShaper(rawL, rawR);
+        }
+        b.startL = rawL;
+        b.startR = rawR;
+        v = 0.0;
+        a = 0.0;
+        b.vJunction = 0.0; // buffer was drained, motion starts from rest
+    } else {
+        const Block& prev = at(count - 1);
+        b.startL = prev.endL;
+        b.startR = prev.endR;
+        b.vJunction = std::min(b.vJunction, prev.vNom);
+    }
+    b.vJunction = std::max(0.0, std::min(b.vJunction, b.vNom));
+    b.vEntry = b.vJunction;
+    b.tNom = b.lenMM / b.vNom;
+
+    ring[(head + count) % BLOCKS] = b;
+    count++;
+    queuedS += b.tNom;
+
+    replan();
+    return true;
+}
+
+void StepStream::replan() {
+    if (count == 0) return;
+
+    // Both passes measure ramps from an anchor: the last point where the speed
+    // is pinned. A trapezoid composes block by block, so there the anchor moves
+    // to every block boundary. An S-curve does not (it would return to zero
+    // acceleration at every boundary), so the anchor only moves at a binding
+    // limit and the ramp uses the lowest acceleration along the way.
+    const bool perBlock = !(jerk > 0.0);
+
+    // Reverse pass: every block must be able to stop at the end of the buffer.
+    const int first = executing ? 1 : 0;
+    double anchorV = 0.0;
+    double anchorDist = 0.0;
+    double anchorAccel = 1e12;
+    for (int i = count - 1; i >= 0; i--) {
+        Block& b = at(i);
+        anchorAccel = std::min(anchorAccel, b.decel);
+        b.brakeV = anchorV;
+        b.brakeDist = anchorDist;
+        b.brakeAccel = anchorAccel;
+        anchorDist += b.lenMM;
+        if (i < first) break;
+
+        const double vMax = reachableSpeed(anchorV, anchorDist, anchorAccel, jerk);
+        if (perBlock || b.vJunction < vMax) {
+            b.vEntry = std::min(b.vJunction, vMax);
+            anchorV = b.vEntry;
+            anchorDist = 0.0;
+            anchorAccel = 1e12;
+        } else {
+            b.vEntry = vMax;
+        }
+    }
+
+    // Forward pass: entry speeds must be reachable from the previous block.
+    // With a jerk limit the entry speeds stay upper bounds: the generator
+    // accelerates as hard as the jerk allows and never jumps to them.
+    if (!perBlock) return;
+    if (executing) {
+        const Block& cur = at(0);
+        anchorV = v;
+        anchorDist = std::max(0.0, cur.lenMM - s);
+    } else {
+        Block& b0 = at(0);
+        b0.vEntry = std::min(b0.vEntry, v);
+        anchorV = b0.vEntry;
+        anchorDist = b0.lenMM;
+    }
+    anchorAccel = at(0).accel;
+    for (int i = 1; i < count; i++) {
+        Block& b = at(i);
+        const double prevExit = reachableSpeed(anchorV, anchorDist, anchorAccel, jerk);
+        if (b.vEntry > prevExit) b.vEntry = prevExit;
+        if (perBlock || b.vEntry < prevExit) {
+            anchorV = b.vEntry;
+            anchorDist = 0.0;
+            anchorAccel = 1e12;
+        }
+        anchorDist += b.lenMM;
+        anchorAccel = std::min(anchorAccel, b.accel);
+    }
+}
+
+double StepStream::stopDistance(double v0, double decel) const {
+    if (!(v0 > 0.0)) return 0.0;
+    if (!(jerk > 0.0)) return v0 * v0 / (2.0 * decel);
+
+    // reachableSpeed() grows with the distance; the ramp takes at most
+    // v0/A + A/J seconds at no more than v0.
+    double lo = 0.0;
+    double hi = v0 * (v0 / decel + decel / jerk);
+    for (int i = 0; i < 40; i++) {
+        const double mid = 0.5 * (lo + hi);
+        if (reachableSpeed(0.0, mid, decel, jerk) >= v0) hi = mid;
+        else lo = mid;
+    }
+    return hi;
+}
+
+bool StepStream::abort() {
+    if (count == 0) return false;
+
+    double decel = 1e12;
+    for (int i = 0; i < count; i++) decel = std::min(decel, at(i).decel);
+    const double dStop = stopDistance(v, decel);
+
+    // Walk forward to the block the ramp ends in and cut it there.
+    const double done = executing ? s : 0.0;
+    int k = 0;
+    double toEnd = at(0).lenMM - done;
+    while (toEnd < dStop && k + 1 < count) {
+        k++;
+        toEnd += at(k).lenMM;
+    }
+
+    Block& b = at(k);
+    const double keep = std::max(b.lenMM - std::max(0.0, toEnd - dStop), k == 0 ? done : 0.0);
+    if (keep < b.lenMM) {
+        const double f = std::max(keep, 1e-6) / b.lenMM;
+        b.endL = b.startL + (b.endL - b.startL) * f;
+        b.endR = b.startR + (b.endR - b.startR) * f;
+        b.lenMM = std::max(keep, 1e-6);
+        b.tNom = b.lenMM / b.vNom;
+    }
+    count = k + 1;
+    queuedS = 0.0;
+    for (int i = 0; i < count; i++) queuedS += at(i).tNom;
+
+    replan();
+    return true;
+}
+
+bool StepStream::settleFits(double remain, double accelNow) const {
+    // Ramp the acceleration out at the jerk limit: T = |a|/J, the speed moves
+    // by a*T/2 and the path by T*(v + a*T/3).
+    const double t = fabs(accelNow) / jerk;
+    const double vSettle = v + 0.5 * accelNow * t;
+    const double dSettle = t * (v + accelNow * t / 3.0);
+    if (vSettle > at(0).vNom) return false;
+
+    // Junction limits passed on the way (only the pinned ones: the others are
+    // the ramp to an anchor further on, which a braking carriage may exceed).
+    // Braking, the speed stays below the chord; accelerating, use the settled speed.
+    int k = 0;
+    double toEnd = remain;
+    while (toEnd < dSettle && k + 1 < count) {
+        const Block& n = at(k + 1);
+        const double vb = (accelNow > 0.0) ? vSettle : v + (vSettle - v) * toEnd / dSettle;
+        if (n.vEntry >= n.vJunction && vb > n.vJunction) return false;
+        k++;
+        if (vSettle > at(k).vNom) return false;
+        toEnd += at(k).lenMM;
+    }
+
+    // ...and the stop ramp from where the speed settles.
+    const Block& c = at(k);
+    const double dStop = c.brakeDist + toEnd - dSettle;
+    const double vLimit = (dStop > 0.0) ? reachableSpeed(c.brakeV, dStop, c.brakeAccel, jerk) : c.brakeV;
+    return vSettle <= vLimit;
+}
+
+double StepStream::jerkLimitedStep(const Block& b, double h, double remain) {
+    // The acceleration changes at the jerk limit: up while the speed can still
+    // settle under the planned limits, otherwise hold, otherwise down.
+    const double jh = jerk * h;
+    if (a > b.accel) a = b.accel;
+    if (a < -b.decel) a = -b.decel;
+
+    const double up = std::min(a + jh, b.accel);
+    if (settleFits(remain, up)) a = up;
+    else if (!settleFits(remain, a)) a = std::max(a - jh, -b.decel);
+
+    double v1 = v + a * h;
+    if (v1 > b.vNom) {
+        v1 = b.vNom;
+        a = 0.0;
+    }
+    if (v1 < 0.0) {
+        v1 = 0.0;
+        a = 0.0;
+    }
+    return v1;
+}
+
+bool StepStream::emitSlice() {
+    if (count == 0 && settleSlices == 0) return false;
+
+    if (activeShaper != Shaper::None && count > 0) updateShaper(at(0).shaperHz > 0.0 ? at(0).shaperHz : shaperHz);
+
+    double tRem = (double)SLICE_US * 1e-6;
+    double posL = rawL;
+    double posR = rawR;
+
+    while (tRem > 1e-9 && count > 0) {
+        Block& b = at(0);
+        if (!executing) {
+            executing = true;
+            s = 0.0;
+            // the S-curve ramp is bounded by vDec below, not by a jump here
+            if (!(jerk > 0.0)) v = std::min(v, b.vEntry);
+        }
+
+        const double vExit = (count > 1) ? at(1).vEntry : 0.0;
+        const double h = std::min(tRem, SUBSTEP_S);
+        const double remain = std::max(0.0, b.lenMM - s);
+
+        double v1;
+        if (jerk > 0.0) {
+            v1 = jerkLimitedStep(b, h, remain);
+            const double vDec = sqrt(b.brakeV * b.brakeV + 2.0 * b.brakeAccel * (b.brakeDist + remain));
+            if (v1 > vDec) {
+                // late for the S-curve stop: the acceleration limit still holds
+                v1 = vDec;
+                a = (v1 - v) / h;
+            }
+        } else {
+            const double vDec = sqrt(vExit * vExit + 2.0 * b.decel * remain);
+            v1 = std::min(std::min(v + b.accel * h, b.vNom), vDec);
+        }
+        const double vFloor = std::min(V_FLOOR_MM_S, b.vNom);
+        if (v1 < vFloor) {
+            v1 = vFloor;
+            if (a < 0.0) a = 0.0;
+        }
+
+        const double ds = 0.5 * (v + v1) * h;
+        if (ds >= remain) {
+            double used = remain / std::max(0.5 * (v + v1), 1e-9);
+            if (used > h) used = h;
+            tRem -= used;
+
+            posL = b.endL;
+            posR = b.endR;
+            v = (jerk > 0.0) ? v + (v1 - v) * (used / h) : std::min(v1, vExit);
+
+            queuedS = (count > 1) ? std::max(0.0, queuedS - b.tNom) : 0.0;
+            head = (head + 1) % BLOCKS;
+            count--;
+            executing = false;
+            s = 0.0;
+            continue;
+        }
+
+        s += ds;
+        v = v1;
+        tRem -= h;
+
+        const double f = s / b.lenMM;
+        posL = b.startL + (b.endL - b.startL) * f;
+        posR = b.startR + (b.endR - b.startR) * f;
+    }
+
+    rawL = posL;
+    rawR = posR;
+
+    // Input shaping; after the last block the planned position is held until
+    // the delayed impulses have caught up.
+    if (activeShaper != Shaper::None) {
+        shape(posL, posR);
+        if (count > 0) settleSlices = (int)ceil(impDelay[impulses - 1]) + 1;
+        else if (settleSlices > 0) settleSlices--;
+    }
+
+    const long targetL = lround(posL);
+    const long targetR = lround(posR);
+
+    // Room was checked by service(), both calls succeed together.
+    left->streamSlice(targetL - emittedL, SLICE_US);
+    right->streamSlice(targetR - emittedR, SLICE_US);
+    emittedL = targetL;
+    emittedR = targetR;
+
+    // The executing block advanced; its reachable exit speed changed.
+    replan();
+    return true;
+}
+
+void StepStream::service() {
+    left->streamPump();
+    right->streamPump();
+
+    if (count == 0 && settleSlices == 0) return;
+
+    if (executing && left->streamQueuedUs() == 0 && right->streamQueuedUs() == 0) underruns++;
+
+    for (int guard = 0; guard < 16 && (count > 0 || settleSlices > 0); guard++) {
+        if (std::min(left->streamQueuedUs(), right->streamQueuedUs()) >= HORIZON_US) break;
+        if (!left->streamHasRoom() || !right->streamHasRoom()) break;
+        emitSlice();
+    }
+}
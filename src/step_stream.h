@@ -0,0 +1,152 @@
+#ifndef STEP_STREAM_H
+#define STEP_STREAM_H
+
+#include <Arduino.h>
+#include "stepper_backend.h"
+
+// Continuous two-motor step generator.
+//
+// Movement pushes short straight blocks (belt targets + XY length/speed). The
+// stream plans entry speeds over its buffer (reverse pass: must be able to stop
+// at the end, forward pass: acceleration limit) and cuts the motion into fixed
+// time slices. Each slice is sent to both backends with identical duration, so
+// the belts stay synchronized and consecutive blocks flow without stopping.
+//
+// With a jerk limit the path speed follows a 7-phase S-curve (jerk, constant
+// acceleration, jerk out; cruise; the mirror image to slow down). The planning
+// passes use the S-curve ramp distance, so junction speeds stay reachable.
+//
+// An optional input shaper (ZV/ZVD/EI) sits between the profile and the
+// backends: the belt positions sent out are a weighted sum of delayed copies
+// of the planned positions, which cancels the carriage swing at the shaper
+// frequency. The output lags by up to one swing period and keeps moving for
+// that long after the last block.
+class StepStream {
+public:
+    static constexpr int BLOCKS = 32;
+
+    enum class Shaper : uint8_t { None = 0, ZV = 1, ZVD = 2, EI = 3 };
+
+    struct Block {
+        double endL;        // belt target, steps
+        double endR;
+        double lenMM;       // path length of the block
+        double vNom;        // mm/s
+        double accel;       // mm/s^2, speeding up
+        double decel;       // mm/s^2, slowing down
+        double vJunction;   // max entry speed (mm/s), set by caller
+        double vEntry;      // planned entry speed (mm/s)
+        double shaperHz;    // swing frequency here (0 = setShaper() value)
+
+        // filled by push()
+        double startL;
+        double startR;
+        double tNom;        // lenMM / vNom, s
+
+        // filled by replan(): where the stop/slow-down ramp ahead is anchored
+        double brakeV;      // mm/s at the anchor
+        double brakeDist;   // mm from the end of this block to the anchor
+        double brakeAccel;  // lowest decel up to the anchor
+    };
+
+    StepStream(StepperBackend* left, StepperBackend* right);
+
+    bool isSupported() const;
+    bool isFull() const { return count >= BLOCKS; }
+    bool isEmpty() const { return count == 0; }
+    bool isActive() const;
+
+    // Queued motion at nominal speed (s, a lower bound on the time it takes);
+    // Movement admits blocks against it so a pause does not coast for long.
+    double queuedSeconds() const { return queuedS; }
+
+    // Belt position at the end of everything queued so far.
+    double tailLeft() const;
+    double tailRight() const;
+
+    // Returns false if the buffer is full.
+    bool push(const Block& block);
+
+    // Called from loop: keeps the backend queues filled.
+    void service();
+
+    // Stops along the path: drops the queued blocks beyond the stopping
+    // distance and shortens the last kept one so the ramp ends at rest. What
+    // was already sent to the backends (one horizon) still plays out. Returns
+    // false if nothing was queued.
+    bool abort();
+
+    // Max jerk in mm/s^3 (0 = trapezoidal profile).
+    void setJerk(double mmPerS3) { jerk = mmPerS3 > 0.0 ? mmPerS3 : 0.0; }
+    double getJerk() const { return jerk; }
+
+    // Highest speed reachable from v0 within distance d (symmetric S-curve
+    // starting and ending at zero acceleration; trapezoid if jerk is 0).
+    static double reachableSpeed(double v0, double d, double accel, double jerk);
+
+    // Takes effect the next time motion starts from rest.
+    void setShaper(Shaper type, double freqHz);
+    double getShaperHz() const { return activeShaper == Shaper::None ? 0.0 : activeHz; }
+
+    uint32_t getUnderruns() const { return underruns; }
+    uint32_t getBackendErrors() const;
+
+private:
+    static constexpr uint32_t SLICE_US = 4000;
+    static constexpr uint32_t HORIZON_US = 48000;
+    static constexpr double SUBSTEP_S = 0.001;
+    static constexpr int HISTORY = 512;           // planned positions, one per slice (~2 s)
+    static constexpr double SHAPER_DAMPING = 0.1;
+
+    StepperBackend* left;
+    StepperBackend* right;
+
+    Block ring[BLOCKS];
+    int head = 0;
+    int count = 0;
+    double queuedS = 0.0;   // sum of tNom over the ring
+
+    // state of the executing block (ring[head])
+    bool executing = false;
+    double s = 0.0;   // mm done in current block
+    double v = 0.0;   // mm/s
+    double a = 0.0;   // mm/s^2, only tracked with a jerk limit
+
+    double jerk = 0.0;
+
+    long emittedL = 0;
+    long emittedR = 0;
+
+    // planned (unshaped) belt position at the end of the last slice
+    double rawL = 0.0;
+    double rawR = 0.0;
+
+    Shaper shaperType = Shaper::None;
+    double shaperHz = 0.0;
+    Shaper activeShaper = Shaper::None;  // latched when motion starts
+    double activeHz = 0.0;
+    int impulses = 0;
+    double impA[3];
+    double impDelay[3];                  // slices
+    double histL[HISTORY];
+    double histR[HISTORY];
+    int histPos = 0;
+    int settleSlices = 0;                // slices still to emit after the last block
+
+    uint32_t underruns = 0;
+
+    Block& at(int i) { return ring[(head + i) % BLOCKS]; }
+    const Block& at(int i) const { return ring[(head + i) % BLOCKS]; }
+
+    void replan();
+    double stopDistance(double v0, double decel) const;
+    bool emitSlice();
+    double jerkLimitedStep(const Block& b, double h, double remain);
+    bool settleFits(double remain, double accelNow) const;
+
+    void resetShaper(double posL, double posR);
+    void updateShaper(double freqHz);
+    void shape(double& posL, double& posR);
+};
+
+#endif
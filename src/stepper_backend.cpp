@@ -109,5 +109,126 @@ void FastStepperBackend::setCurrentPosition(long pos) {
   if (!_stepper) return;
   _stepper->setCurrentPosition((int32_t)pos);
   _target = pos;
+  _carrySteps = 0;
+  _carryTicks = 0;
 }
 
+
+// ---------------------------------------------------------------------------
+// Streaming
+// ---------------------------------------------------------------------------
+
+static constexpr uint32_t TICKS_PER_US = (uint32_t)(TICKS_PER_S / 1000000L);
+static constexpr uint32_t MAX_CMD_TICKS = 65535u;
+// Hard ceiling for the step rate of a streamed slice (far above any plotting speed).
+static constexpr uint32_t STREAM_MIN_STEP_TICKS = (uint32_t)(TICKS_PER_S / 40000L);
+
+bool FastStepperBackend::pushCommand(uint16_t ticks, uint8_t steps, bool countUp) {
+  if (_fifoCount >= STREAM_FIFO_LEN) return false;
+  const int ix = (_fifoHead + _fifoCount) % STREAM_FIFO_LEN;
+  _fifo[ix].ticks = ticks;
+  _fifo[ix].steps = steps;
+  _fifo[ix].count_up = countUp;
+  _fifoCount++;
+  _fifoTicks += (uint32_t)ticks * (steps > 0 ? steps : 1u);
+  return true;
+}
+
+bool FastStepperBackend::streamSlice(long steps, uint32_t durationUs) {
+  if (!_stepper) return false;
+
+  const long total = steps + _carrySteps;
+  const int64_t dur = (int64_t)durationUs * TICKS_PER_US + _carryTicks;
+
+  // Too short for a queue command: fold it into the next slice.
+  if (dur < 2 * (int64_t)MIN_CMD_TICKS) {
+    _carrySteps = total;
+    _carryTicks = (int32_t)dur;
+    _target += steps;
+    return true;
+  }
+
+  const bool up = (total >= 0);
+  const uint32_t n = (uint32_t)((total >= 0) ? total : -total);
+
+  uint32_t period = 0;
+  uint32_t sub = 1;
+  int needed = 0;
+  if (n == 0) {
+    needed = (int)((dur + MAX_CMD_TICKS - 1) / MAX_CMD_TICKS);
+  } else {
+    period = (uint32_t)(dur / n);
+    if (period < STREAM_MIN_STEP_TICKS) {
+      period = STREAM_MIN_STEP_TICKS;
+      _streamErrors++;
+    }
+    if (period <= MAX_CMD_TICKS) {
+      needed = (int)((n + 254) / 255);
+    } else {
+      sub = (period + MAX_CMD_TICKS - 1) / MAX_CMD_TICKS;
+      needed = (int)(n * sub);
+    }
+  }
+  if (needed > STREAM_FIFO_LEN - _fifoCount) return false;
+
+  int64_t emitted = 0;
+  if (n == 0) {
+    const uint32_t chunks = (uint32_t)needed;
+    const uint32_t each = (uint32_t)(dur / chunks);
+    for (uint32_t i = 0; i < chunks; i++) pushCommand((uint16_t)each, 0, up);
+    emitted = (int64_t)each * chunks;
+  } else if (sub == 1) {
+    // Balanced chunks of <= 255 steps at a constant step period.
+    const uint32_t chunks = (uint32_t)needed;
+    uint32_t left = n;
+    for (uint32_t i = 0; i < chunks; i++) {
+      const uint32_t c = left / (chunks - i);
+      pushCommand((uint16_t)period, (uint8_t)c, up);
+      left -= c;
+    }
+    emitted = (int64_t)period * n;
+  } else {
+    // Slow motor: one step followed by pauses, each part <= 16 bit ticks.
+    const uint32_t part = period / sub;
+    for (uint32_t i = 0; i < n; i++) {
+      pushCommand((uint16_t)part, 1, up);
+      for (uint32_t k = 1; k < sub; k++) pushCommand((uint16_t)part, 0, up);
+    }
+    emitted = (int64_t)part * sub * n;
+  }
+
+  _carrySteps = 0;
+  _carryTicks = (int32_t)(dur - emitted);
+  _target += steps;
+
+  streamPump();
+  return true;
+}
+
+bool FastStepperBackend::streamHasRoom() const {
+  return (STREAM_FIFO_LEN - _fifoCount) >= STREAM_SLICE_MAX_ENTRIES;
+}
+
+void FastStepperBackend::streamPump() {
+  if (!_stepper) return;
+  while (_fifoCount > 0) {
+    const stepper_command_s& cmd = _fifo[_fifoHead];
+    const int8_t rc = _stepper->addQueueEntry(&cmd, true);
+    if (rc > 0) break; // queue full / dir pin busy: retry on next pump
+    if (rc < 0) _streamErrors++; // rejected command: drop it so the stream cannot wedge
+
+    _fifoTicks -= (uint32_t)cmd.ticks * (cmd.steps > 0 ? cmd.steps : 1u);
+    _fifoHead = (_fifoHead + 1) % STREAM_FIFO_LEN;
+    _fifoCount--;
+  }
+}
+
+uint32_t FastStepperBackend::streamQueuedUs() const {
+  if (!_stepper) return 0;
+  return (_fifoTicks + _stepper->ticksInQueue()) / TICKS_PER_US;
+}
+
+bool FastStepperBackend::streamBusy() const {
+  if (!_stepper) return false;
+  return _fifoCount > 0 || _stepper->isRunning();
+}
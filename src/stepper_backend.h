@@ -35,6 +35,17 @@ public:
 
   // Pulse width is not configurable with FastAccelStepper. Keep API as no-op for compatibility.
   virtual void setMinPulseWidth(unsigned int us) = 0;
+
+  // Streaming: append a pre-timed slice of `steps` (signed) spread evenly over
+  // `durationUs`. StepStream feeds both motors slices of identical duration,
+  // which keeps them synchronized without a ramp per segment.
+  virtual bool supportsStreaming() const = 0;
+  virtual bool streamSlice(long steps, uint32_t durationUs) = 0;
+  virtual bool streamHasRoom() const = 0;
+  virtual void streamPump() = 0;               // move buffered slices into the hardware queue
+  virtual uint32_t streamQueuedUs() const = 0; // motion time not yet executed
+  virtual bool streamBusy() const = 0;
+  virtual uint32_t streamErrors() const = 0;
 };
 
 // FastAccelStepper uses a global engine
@@ -65,9 +76,34 @@ public:
 
   void setMinPulseWidth(unsigned int) override {} // not supported
 
+  bool supportsStreaming() const override { return _stepper != nullptr; }
+  bool streamSlice(long steps, uint32_t durationUs) override;
+  bool streamHasRoom() const override;
+  void streamPump() override;
+  uint32_t streamQueuedUs() const override;
+  bool streamBusy() const override;
+  uint32_t streamErrors() const override { return _streamErrors; }
+
 private:
   static FastAccelStepperEngine& engine();
 
+  // Software FIFO in front of the FastAccelStepper command queue (32 entries on ESP32).
+  // A slice is only accepted if all of its commands fit, so slices are never split.
+  static constexpr int STREAM_FIFO_LEN = 48;
+  static constexpr int STREAM_SLICE_MAX_ENTRIES = 8;
+
+  bool pushCommand(uint16_t ticks, uint8_t steps, bool countUp);
+
+  stepper_command_s _fifo[STREAM_FIFO_LEN];
+  int _fifoHead = 0;
+  int _fifoCount = 0;
+  uint32_t _fifoTicks = 0;
+
+  // Rounding remainder so both motors keep the exact same timeline.
+  int32_t _carryTicks = 0;
+  long _carrySteps = 0;
+  uint32_t _streamErrors = 0;
+
   FastAccelStepper* _stepper = nullptr;
   uint8_t _dirPin = 255;
   bool _dirInvert = false;
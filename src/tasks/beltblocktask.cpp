@@ -0,0 +1,37 @@
+#include "beltblocktask.h"
+#include "service/weblog.h"
+
+const char* BeltBlockTask::NAME = "BeltBlockTask";
+
+void BeltBlockTask::reset(Movement* movement, Movement::Point target, long beltL, long beltR, double vNom, double vJunction) {
+    this->movement = movement;
+    this->target = target;
+    this->beltL = beltL;
+    this->beltR = beltR;
+    this->vNom = vNom;
+    this->vJunction = vJunction;
+    queued = false;
+}
+
+bool BeltBlockTask::tryQueue() {
+    if (!movement->canQueueSegment()) return false;
+    try {
+        movement->queueBeltBlock(target.x, target.y, beltL, beltR, vNom, vJunction);
+    } catch (const std::exception& e) {
+        WebLog::error(String("BeltBlockTask error: ") + e.what());
+    } catch (...) {
+        WebLog::error("BeltBlockTask unknown error");
+    }
+    return true;
+}
+
+void BeltBlockTask::startRunning() {
+    if (!movement) return;
+    queued = tryQueue();
+}
+
+bool BeltBlockTask::isDone() {
+    if (!movement) return true;
+    if (!queued) queued = tryQueue();
+    return queued;
+}
@@ -0,0 +1,33 @@
+#ifndef BeltBlockTask_h
+#define BeltBlockTask_h
+
+#include "movement.h"
+#include "task.h"
+
+// One block of a compiled job (see Movement::queueBeltBlock()). Streaming only:
+// done as soon as the block is queued.
+class BeltBlockTask : public Task {
+private:
+    Movement* movement = nullptr;
+    Movement::Point target;
+    long beltL = 0;
+    long beltR = 0;
+    double vNom = 0.0;        // mm/s, <= 0 = move speed
+    double vJunction = 0.0;   // mm/s
+    bool queued = false;
+
+    bool tryQueue();
+
+public:
+    static const char* NAME;
+
+    BeltBlockTask() {}
+    void reset(Movement* movement, Movement::Point target, long beltL, long beltR, double vNom, double vJunction);
+
+    bool isDone() override;
+    void startRunning() override;
+
+    const char* name() override { return NAME; }
+};
+
+#endif
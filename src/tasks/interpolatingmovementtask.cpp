@@ -4,25 +4,82 @@
 
 const char* InterpolatingMovementTask::NAME = "InterpolatingMovementTask";
 
-InterpolatingMovementTask::InterpolatingMovementTask(Movement* movement, Movement::Point target, int speedSteps) {
+InterpolatingMovementTask::InterpolatingMovementTask(Movement* movement, Movement::Point target, double speed, double entrySpeedMmS, bool travel) {
+    reset(movement, target, speed, entrySpeedMmS, travel);
+}
+
+void InterpolatingMovementTask::reset(Movement* movement, Movement::Point target, double speed, double entrySpeedMmS, bool travel) {
     this->movement = movement;
     this->target = target;
-    this->speedSteps = speedSteps;
+    this->speed = speed;
+    this->entrySpeedMmS = entrySpeedMmS;
+    this->travel = travel;
+
+    started = false;
+    streaming = false;
+    beltSpace = false;
+    distance = 0.0;
+    segmentIndex = 0;
+    segmentCount = 0;
+    adaptive = false;
+    spanCount = 0;
+}
+
+Movement::Point InterpolatingMovementTask::pointAt(double t) const {
+    return Movement::Point(start.x + (target.x - start.x) * t, start.y + (target.y - start.y) * t);
+}
+
+bool InterpolatingMovementTask::hasMoreSegments() const {
+    return adaptive ? (spanCount > 0) : (segmentIndex < segmentCount);
+}
+
+void InterpolatingMovementTask::dropSegments() {
+    spanCount = 0;
+    segmentIndex = segmentCount;
+}
+
+// End parameter of the next segment to send.
+double InterpolatingMovementTask::nextSegmentT() {
+    if (!adaptive) return (double)(segmentIndex + 1) / (double)segmentCount;
+
+    while (spanCount > 0) {
+        const Span sp = spans[--spanCount];
+        const double len = distance * (sp.t1 - sp.t0);
+
+        if (len >= 2.0 * minSegmentMM && spanCount + 2 <= MAX_SPANS &&
+            movement->beltChordDeviationMM(pointAt(sp.t0), pointAt(sp.t1)) > maxDeviationMM) {
+            const double tm = 0.5 * (sp.t0 + sp.t1);
+            spans[spanCount++] = { tm, sp.t1 };
+            spans[spanCount++] = { sp.t0, tm };
+            continue;
+        }
+        return sp.t1;
+    }
+    return 1.0;
 }
 
 void InterpolatingMovementTask::startNextSegment() {
     if (!movement) return;
-    if (segmentCount <= 0) return;
-    if (segmentIndex >= segmentCount) return;
+    if (!hasMoreSegments()) return;
 
-    const double t = (double)(segmentIndex + 1) / (double)segmentCount;
-    const double x = start.x + (target.x - start.x) * t;
-    const double y = start.y + (target.y - start.y) * t;
+    const Movement::Point p = pointAt(nextSegmentT());
 
-    movement->beginLinearTravel(x, y, speedSteps);
+    if (beltSpace) movement->beginBeltTravel(p.x, p.y, speed);
+    else movement->beginLinearTravel(p.x, p.y, speed);
     segmentIndex++;
 }
 
+void InterpolatingMovementTask::queueSegments() {
+    while (hasMoreSegments() && movement->canQueueSegment()) {
+        const Movement::Point p = pointAt(nextSegmentT());
+
+        const double entryCap = (segmentIndex == 0) ? entrySpeedMmS : -1.0;
+        if (beltSpace) movement->queueBeltTravel(p.x, p.y, speed, entryCap);
+        else movement->queueLinearSegment(p.x, p.y, speed, entryCap);
+        segmentIndex++;
+    }
+}
+
 void InterpolatingMovementTask::startRunning() {
     if (!movement) return;
 
@@ -30,11 +87,12 @@ void InterpolatingMovementTask::startRunning() {
         // IMPORTANT:
         // A V-plotter cannot create a straight XY line by commanding only final belt lengths.
         // We must interpolate in XY and call IK (getBeltLengths) per segment.
-        start = movement->getCoordinatesLive();
+        start = movement->getCommandedCoordinates();
 
         const double dx = target.x - start.x;
         const double dy = target.y - start.y;
         const double dist = sqrt(dx * dx + dy * dy);
+        distance = dist;
 
         // Use planner config, but keep sane lower bound.
         const auto cfg = movement->getPlannerConfig();
@@ -45,18 +103,38 @@ void InterpolatingMovementTask::startRunning() {
         segmentCount = (dist <= 1e-6) ? 1 : (int)ceil(dist / segLen);
         if (segmentCount < 1) segmentCount = 1;
 
+        // Pen-up: the path does not matter, move both belts in one go if that stays on the wall.
+        beltSpace = false;
+        if (travel && segmentCount > 1 && cfg.beltSpaceTravel && movement->isBeltPathSafe(start, target)) {
+            beltSpace = true;
+            segmentCount = 1;
+        }
+
+        // Error-bounded slicing: only as fine as the belt/XY non-linearity requires.
+        adaptive = !beltSpace && segmentCount > 1 && cfg.maxDeviationMM > 0.0;
+        if (adaptive) {
+            maxDeviationMM = cfg.maxDeviationMM;
+            minSegmentMM = segLen;
+            spans[0] = { 0.0, 1.0 };
+            spanCount = 1;
+        }
+
         segmentIndex = 0;
         started = true;
+        streaming = movement->isStreaming();
 
-        startNextSegment();
+        if (streaming) queueSegments();
+        else startNextSegment();
     } catch (const std::exception& e) {
         WebLog::error(String("InterpolatingMovementTask start error: ") + e.what());
         started = true; // avoid deadlock in runner
         segmentCount = 0;
+        spanCount = 0;
     } catch (...) {
         WebLog::error("InterpolatingMovementTask start unknown error");
         started = true; // avoid deadlock in runner
         segmentCount = 0;
+        spanCount = 0;
     }
 }
 
@@ -64,26 +142,41 @@ bool InterpolatingMovementTask::isDone() {
     if (!started) return false;
     if (!movement) return true;
 
-    // If current segment still moving, task is not done.
-    if (movement->isMoving()) return false;
-
-    // If there are still segments left, start the next one.
-    if (segmentIndex < segmentCount) {
+    if (streaming) {
+        // Done as soon as the last segment is queued, so the next move
+        // is blended in by the stream instead of starting from rest.
+        if (hasMoreSegments()) {
+            try {
+                queueSegments();
+            } catch (const std::exception& e) {
+                WebLog::error(String("InterpolatingMovementTask segment error: ") + e.what());
+                dropSegments();
+            } catch (...) {
+                WebLog::error("InterpolatingMovementTask segment unknown error");
+                dropSegments();
+            }
+            if (hasMoreSegments()) return false;
+        }
+    } else if (movement->isMoving()) {
+        // If current segment still moving, task is not done.
+        return false;
+    } else if (hasMoreSegments()) {
+        // If there are still segments left, start the next one.
         try {
             startNextSegment();
         } catch (const std::exception& e) {
             WebLog::error(String("InterpolatingMovementTask segment error: ") + e.what());
             // fall through, allow runner to continue
-            segmentIndex = segmentCount;
+            dropSegments();
         } catch (...) {
             WebLog::error("InterpolatingMovementTask segment unknown error");
-            segmentIndex = segmentCount;
+            dropSegments();
         }
         return false;
     }
 
     // Final tolerance check
-    Movement::Point p = movement->getCoordinatesLive();
+    Movement::Point p = movement->getCommandedCoordinates();
     const double dx = p.x - target.x;
     const double dy = p.y - target.y;
     const double d = sqrt(dx * dx + dy * dy);
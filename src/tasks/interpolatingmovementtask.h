@@ -8,21 +8,50 @@ class InterpolatingMovementTask : public Task {
 private:
     Movement* movement;
     Movement::Point target;
-    int speedSteps;
+    double speed;         // steps/s of the dominant motor, or mm/s in feed mode
+    double entrySpeedMmS;
+    bool travel;
 
     bool started = false;
+    bool streaming = false;
+    bool beltSpace = false;   // travel executed as one belt-space move
 
     // segmented straight-line planning in XY
     Movement::Point start;
-    int segmentIndex = 0;
-    int segmentCount = 0;
+    double distance = 0.0;
+    int segmentIndex = 0;     // segments sent so far
+    int segmentCount = 0;     // fixed slicing only
+
+    // Adaptive slicing: spans [t0, t1] still to send, the top of the stack comes
+    // next. A span is split while its belt-space chord deviates too far from XY.
+    struct Span {
+        double t0;
+        double t1;
+    };
+    static constexpr int MAX_SPANS = 32;
+    bool adaptive = false;
+    Span spans[MAX_SPANS];
+    int spanCount = 0;
+    double maxDeviationMM = 0.0;
+    double minSegmentMM = 0.5;
+
+    Movement::Point pointAt(double t) const;
+    bool hasMoreSegments() const;
+    double nextSegmentT();
+    void dropSegments();
 
     void startNextSegment();
+    void queueSegments();
 
 public:
     static const char* NAME;
 
-    InterpolatingMovementTask(Movement* movement, Movement::Point target, int speedSteps);
+    // entrySpeedMmS: planned junction speed into this move (streaming only), < 0 = unlimited.
+    // travel: pen-up move, the path does not matter (see PlannerConfig::beltSpaceTravel).
+    InterpolatingMovementTask(Movement* movement, Movement::Point target, double speed, double entrySpeedMmS = -1.0, bool travel = false);
+
+    // Reuse this object for the next move (the runner keeps one, see Runner).
+    void reset(Movement* movement, Movement::Point target, double speed, double entrySpeedMmS = -1.0, bool travel = false);
 
     bool isDone() override;
     void startRunning() override;
@@ -5,6 +5,12 @@ PenTask::PenTask(bool up, Pen *pen, int settleMs)
 : pen(pen), up(up), settleMs(settleMs) {
 }
 
+void PenTask::reset(bool up, Pen *pen, int settleMs) {
+    this->up = up;
+    this->pen = pen;
+    this->settleMs = settleMs;
+}
+
 void PenTask::startRunning() {
     Serial.print(F("Starting pen task: "));
     Serial.println(up ? F("UP") : F("DOWN"));
@@ -10,6 +10,7 @@ class PenTask : public Task {
     int settleMs;
     public:
     PenTask(bool up, Pen *pen, int settleMs);
+    void reset(bool up, Pen *pen, int settleMs);
     bool isDone();
     void startRunning();
     const char* name() {
@@ -0,0 +1,61 @@
+// Host tests of the kinematics kernel: pio test -e native
+#include <unity.h>
+#include <cmath>
+#include "kinematics.h"
+
+static const double A = 1000.0;   // mm/s^2
+static const double JD = 0.02;    // mm
+
+void setUp() {}
+void tearDown() {}
+
+static double junctionAtTurnDeg(double deg) {
+    return kin::junctionSpeed(std::cos(deg * kin::PI_D / 180.0), A, JD);
+}
+
+void test_straight_is_unlimited() {
+    TEST_ASSERT_TRUE(junctionAtTurnDeg(0.0) >= 1e9);
+}
+
+void test_reversal_stops() {
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3, 0.0, junctionAtTurnDeg(180.0));
+    TEST_ASSERT_TRUE(junctionAtTurnDeg(179.0) < 1.0);
+}
+
+void test_right_angle_matches_grbl() {
+    // inner angle 90 deg: s = sin(45 deg)
+    const double s = std::sqrt(0.5);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-9, std::sqrt(A * JD * s / (1.0 - s)), junctionAtTurnDeg(90.0));
+}
+
+void test_sharper_turn_is_slower() {
+    double last = 1e18;
+    for (int deg = 1; deg <= 180; deg++) {
+        const double v = junctionAtTurnDeg(deg);
+        TEST_ASSERT_TRUE(v <= last);
+        last = v;
+    }
+    // a slight bend of a polyline keeps most of the speed
+    TEST_ASSERT_TRUE(junctionAtTurnDeg(2.0) > 100.0);
+}
+
+void test_float_matches_double() {
+    // the planner runs this in KinScalar; float must stay within 0.1% of double
+    for (int deg = 1; deg < 180; deg++) {
+        const double c = std::cos(deg * kin::PI_D / 180.0);
+        const double vd = kin::junctionSpeed(c, A, JD);
+        const float vf = kin::junctionSpeed((float)c, (float)A, (float)JD);
+        TEST_ASSERT_DOUBLE_WITHIN(1e-3 * vd + 1e-3, vd, (double)vf);
+    }
+    TEST_ASSERT_TRUE(kin::junctionSpeed(1.0f, (float)A, (float)JD) >= 1e9f);
+}
+
+int main(int, char**) {
+    UNITY_BEGIN();
+    RUN_TEST(test_straight_is_unlimited);
+    RUN_TEST(test_reversal_stops);
+    RUN_TEST(test_right_angle_matches_grbl);
+    RUN_TEST(test_sharper_turn_is_slower);
+    RUN_TEST(test_float_matches_double);
+    return UNITY_END();
+}
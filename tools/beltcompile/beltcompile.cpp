@@ -0,0 +1,599 @@
+// beltcompile: turns a /commands job into the compiled belt-space format
+// (src/command_format.h, magic "VPC1") on a PC, so the plotter only streams
+// step targets and solves no IK while drawing.
+//
+//   g++ -std=c++17 -O2 -I src -o beltcompile tools/beltcompile/beltcompile.cpp
+//   ./beltcompile [options] commands.txt commands.vpc
+//
+// The machine parameters default to the constants in src/movement.h. Save the
+// plotter's /diag JSON and pass it with --diag to take topDistance, the TCP
+// offset and the rest from the machine itself; the plotter rejects a file whose
+// header does not match. Flags after --diag override single values.
+//
+// Input is the text format or the binary one ("VPB1").
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "kinematics.h"
+#include "command_format.h"
+
+namespace {
+
+constexpr double PI_D = kin::PI_D;
+
+struct Params {
+    // geometry, as in movement.h
+    double topDistance = -1.0;
+    double tcpX = 0.0;
+    double tcpY = -30.0;
+    int stepsPerRotation = 200 * 64;
+    double travelPerRotation = 12.69 * PI_D;
+    double dT = 76.027;
+    double dP = 4.4866;
+    double dM = 10.0 + 4.4866;
+    double wallOffset = 41.0;
+    double massKg = 1.5;
+    double gravity = 9.81;
+    double safeX = 0.2;
+    double safeY = 0.2;
+    double elongation = 0.0;
+    bool kinFloat = false;
+
+    // planning
+    double printSpeed = 40.0;     // mm/s
+    double moveSpeed = 80.0;      // mm/s
+    double accelSteps = 999999999.0;
+    double junctionDeviation = 0.02;
+    int maxStepRate = 4000;
+    double segmentMM = 1.0;
+    double arcTolerance = 0.02;
+    double ikToleranceDeg = 0.001;
+};
+
+struct Cmd {
+    enum Kind { Other, Pen, Move, Arc } kind = Other;
+    bool down = false;
+    bool cw = false;
+    double x = 0.0, y = 0.0, i = 0.0, j = 0.0;
+};
+
+// ---------------------------------------------------------------- input
+
+bool readFile(const char* path, std::vector<uint8_t>& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+// Same grammar as CommandReader::parseLine().
+bool parseTextLine(const char* line, Cmd& c) {
+    c = Cmd();
+    while (*line == ' ' || *line == '\t') line++;
+    if (!*line) return false;
+
+    if (line[0] == 'p') {
+        c.kind = Cmd::Pen;
+        c.down = (line[1] == '1');
+        return true;
+    }
+
+    if ((line[0] == 'g' || line[0] == 'G') && (line[1] == '2' || line[1] == '3')) {
+        c.cw = (line[1] == '2');
+        double labelled[4] = {0, 0, 0, 0}, positional[4] = {0, 0, 0, 0};
+        bool has[4] = {false, false, false, false};
+        bool anyLabel = false;
+        int count = 0;
+        const char* p = line + 2;
+        while (*p) {
+            while (*p == ' ' || *p == '\t') p++;
+            if (!*p) break;
+            int slot = -1;
+            switch (*p) {
+                case 'x': case 'X': slot = 0; break;
+                case 'y': case 'Y': slot = 1; break;
+                case 'i': case 'I': slot = 2; break;
+                case 'j': case 'J': slot = 3; break;
+                default: break;
+            }
+            char* e;
+            if (slot >= 0) {
+                labelled[slot] = strtod(p + 1, &e);
+                has[slot] = true;
+                anyLabel = true;
+            } else {
+                const double v = strtod(p, &e);
+                if (count < 4) positional[count] = v;
+            }
+            count++;
+            if (e == p) e++;
+            p = e;
+            while (*p && *p != ' ' && *p != '\t') p++;
+        }
+        const double* v = anyLabel ? labelled : positional;
+        if (anyLabel ? !(has[0] && has[1] && has[2] && has[3]) : count < 4) return false;
+        c.kind = Cmd::Arc;
+        c.x = v[0];
+        c.y = v[1];
+        c.i = v[2];
+        c.j = v[3];
+        return true;
+    }
+
+    char* e;
+    c.x = strtod(line, &e);
+    if (e == line) return false;
+    const char* p = e;
+    c.y = strtod(p, &e);
+    if (e == p) return false;
+    c.kind = Cmd::Move;
+    return true;
+}
+
+bool parseInput(const std::vector<uint8_t>& data, std::vector<Cmd>& cmds, double& total, double& height) {
+    cmdbin::Header h;
+    if (cmdbin::decodeHeader(data.data(), data.size(), h) && cmdbin::isBinary(data.data(), data.size())) {
+        total = cmdbin::toMM(h.totalDistance);
+        height = cmdbin::toMM(h.height);
+        const uint8_t* p = data.data() + cmdbin::HEADER_SIZE;
+        const uint8_t* end = data.data() + data.size();
+        int32_t x = 0, y = 0;
+        while (p < end) {
+            const uint8_t op = *p++;
+            Cmd c;
+            int32_t v[4] = {0, 0, 0, 0};
+            int operands = 0;
+            if (op == cmdbin::OP_PEN_UP || op == cmdbin::OP_PEN_DOWN) {
+                c.kind = Cmd::Pen;
+                c.down = (op == cmdbin::OP_PEN_DOWN);
+            } else if (op == cmdbin::OP_MOVE) {
+                c.kind = Cmd::Move;
+                operands = 2;
+            } else if (op == cmdbin::OP_ARC_CW || op == cmdbin::OP_ARC_CCW) {
+                c.kind = Cmd::Arc;
+                c.cw = (op == cmdbin::OP_ARC_CW);
+                operands = 4;
+            } else {
+                return false;
+            }
+            for (int k = 0; k < operands; k++) {
+                if (!cmdbin::getVarint(p, end, v[k])) return false;
+            }
+            if (operands > 0) {
+                x += v[0];
+                y += v[1];
+                c.x = cmdbin::toMM(x);
+                c.y = cmdbin::toMM(y);
+                c.i = cmdbin::toMM(v[2]);
+                c.j = cmdbin::toMM(v[3]);
+            }
+            cmds.push_back(c);
+        }
+        return true;
+    }
+
+    std::string text(data.begin(), data.end());
+    size_t pos = 0;
+    int lineNo = 0;
+    while (pos < text.size()) {
+        size_t nl = text.find('\n', pos);
+        if (nl == std::string::npos) nl = text.size();
+        std::string line = text.substr(pos, nl - pos);
+        pos = nl + 1;
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) line.pop_back();
+        if (line.empty()) continue;
+
+        lineNo++;
+        if (lineNo == 1) {
+            if (line[0] != 'd') return false;
+            total = atof(line.c_str() + 1);
+            continue;
+        }
+        if (lineNo == 2) {
+            if (line[0] != 'h') return false;
+            height = atof(line.c_str() + 1);
+            continue;
+        }
+        Cmd c;
+        if (parseTextLine(line.c_str(), c)) cmds.push_back(c);
+    }
+    return lineNo >= 2;
+}
+
+// ---------------------------------------------------------------- /diag
+
+bool diagNumber(const std::string& json, const char* key, double& out) {
+    const std::string k = std::string("\"") + key + "\"";
+    size_t p = json.find(k);
+    if (p == std::string::npos) return false;
+    p = json.find(':', p + k.size());
+    if (p == std::string::npos) return false;
+    p++;
+    while (p < json.size() && (json[p] == ' ' || json[p] == '\t')) p++;
+    if (json.compare(p, 4, "true") == 0) { out = 1.0; return true; }
+    if (json.compare(p, 5, "false") == 0) { out = 0.0; return true; }
+    char* e;
+    const double v = strtod(json.c_str() + p, &e);
+    if (e == json.c_str() + p) return false;
+    out = v;
+    return true;
+}
+
+bool loadDiag(const char* path, Params& prm) {
+    std::vector<uint8_t> data;
+    if (!readFile(path, data)) return false;
+    const std::string json(data.begin(), data.end());
+
+    double v;
+    if (diagNumber(json, "topDistance", v)) prm.topDistance = v;
+    if (diagNumber(json, "tcpOffsetXmm", v)) prm.tcpX = v;
+    if (diagNumber(json, "tcpOffsetYmm", v)) prm.tcpY = v;
+    if (diagNumber(json, "stepsPerRotation", v)) prm.stepsPerRotation = (int)v;
+    if (diagNumber(json, "travelPerRotationMM", v)) prm.travelPerRotation = v;
+    if (diagNumber(json, "d_t", v)) prm.dT = v;
+    if (diagNumber(json, "d_p", v)) prm.dP = v;
+    if (diagNumber(json, "d_m", v)) prm.dM = v;
+    if (diagNumber(json, "midPulleyToWall", v)) prm.wallOffset = v;
+    if (diagNumber(json, "mass_bot", v)) prm.massKg = v;
+    if (diagNumber(json, "g_constant", v)) prm.gravity = v;
+    if (diagNumber(json, "safeXFraction", v)) prm.safeX = v;
+    if (diagNumber(json, "safeYFraction", v)) prm.safeY = v;
+    if (diagNumber(json, "belt_elongation_coefficient", v)) prm.elongation = v;
+    if (diagNumber(json, "kin_float", v)) prm.kinFloat = (v != 0.0);
+    if (diagNumber(json, "acceleration", v)) prm.accelSteps = v;
+    return true;
+}
+
+// ---------------------------------------------------------------- IK
+
+// Pen tip -> belt steps, the same steps as Movement::getBeltLengths() with the
+// exact (non-table) solve.
+template <typename T>
+class BeltSolver {
+public:
+    explicit BeltSolver(const Params& p) : prm(p) {
+        originX = p.safeX * p.topDistance;
+        originY = p.safeY * p.topDistance;
+        width = p.topDistance - 2.0 * originX;
+        stepsPerMM = (double)p.stepsPerRotation / p.travelPerRotation;
+
+        geo.topDistance = T(p.topDistance);
+        geo.originX = T(originX);
+        geo.originY = T(originY);
+        geo.d_t = T(p.dT);
+        geo.d_p = T(p.dP);
+        geo.d_m = T(p.dM);
+        geo.weight = T(p.massKg * p.gravity);
+        geo.wallOffset = T(p.wallOffset);
+    }
+
+    void steps(double penX, double penY, long& left, long& right) {
+        const double cx = std::max(0.0, std::min(width, penX - prm.tcpX));
+        const double cy = std::max(0.0, penY - prm.tcpY);
+        const T frameX = T(cx + originX);
+        const T frameY = T(cy + originY);
+
+        T g = T(gamma);
+        T fl = T(0), fr = T(0);
+        const T tolerance = T(prm.ikToleranceDeg * PI_D / 180.0);
+        if (!kin::solveTiltNewton<T>(geo, frameX, frameY, tolerance, g, fl, fr)) {
+            // the plotter falls back to its scan solver here; retry level
+            g = T(0);
+            if (!kin::solveTiltNewton<T>(geo, frameX, frameY, tolerance, g, fl, fr)) {
+                g = T(0);
+                fl = fr = T(0);
+                fallbacks++;
+            }
+        }
+        gamma = g;
+
+        T l, r;
+        kin::beltLegs<T>(geo, frameX, frameY, g, l, r);
+        const double leftMM = (double)l / (1.0 + prm.elongation * (double)fl);
+        const double rightMM = (double)r / (1.0 + prm.elongation * (double)fr);
+        left = (long)(int)(leftMM * stepsPerMM);
+        right = (long)(int)(rightMM * stepsPerMM);
+    }
+
+    double stepsPerMM = 0.0;
+    int fallbacks = 0;
+
+private:
+    const Params& prm;
+    kin::Geometry<T> geo{};
+    double originX = 0.0, originY = 0.0, width = 0.0;
+    double gamma = 0.0;
+};
+
+// Movement::beltJunctionSpeedMmS()
+double beltJunctionSpeed(double prevDL, double prevDR, double dL, double dR, double lenMM, double accelSteps,
+                         double junctionDeviation, double stepsPerMM) {
+    const double n0 = kin::length(prevDL, prevDR);
+    const double n1 = kin::length(dL, dR);
+    if (n0 < 1e-9 || n1 < 1e-9 || lenMM < 1e-9) return 1e9;
+
+    double cosTurn = (prevDL * dL + prevDR * dR) / (n0 * n1);
+    cosTurn = std::max(-1.0, std::min(1.0, cosTurn));
+
+    const double cosHalf = sqrt(0.5 * (1.0 + cosTurn));
+    if (cosHalf > 1.0 - 1e-9) return 1e9;
+    const double vSteps = sqrt(accelSteps * junctionDeviation * stepsPerMM * cosHalf / (1.0 - cosHalf));
+    return vSteps * lenMM / n1;
+}
+
+// ---------------------------------------------------------------- output
+
+template <typename T>
+class Compiler {
+public:
+    Compiler(const Params& p) : prm(p), ik(p) {}
+
+    bool run(const std::vector<Cmd>& cmds, double total, double height, std::vector<uint8_t>& out) {
+        cmdbin::CompiledHeader head;
+        head.base.totalDistance = cmdbin::toUnits(total);
+        head.base.height = cmdbin::toUnits(height);
+        head.machine = cmdbin::makeMachine(prm.topDistance, prm.tcpX, prm.tcpY, prm.stepsPerRotation,
+                                           prm.travelPerRotation, prm.dT, prm.dP, prm.dM, prm.wallOffset, prm.massKg,
+                                           prm.gravity, prm.safeX, prm.safeY, prm.elongation, prm.kinFloat);
+
+        // the plotter travels to the first point before the first record
+        for (const Cmd& c : cmds) {
+            if (c.kind == Cmd::Move || c.kind == Cmd::Arc) {
+                posX = c.x;
+                posY = c.y;
+                break;
+            }
+        }
+        unitX = head.startX = cmdbin::toUnits(posX);
+        unitY = head.startY = cmdbin::toUnits(posY);
+        ik.steps(posX, posY, beltL, beltR);
+        head.startL = (int32_t)beltL;
+        head.startR = (int32_t)beltR;
+        head.base.minX = head.base.maxX = unitX;
+        head.base.minY = head.base.maxY = unitY;
+
+        out.assign(cmdbin::COMPILED_HEADER_SIZE, 0);
+        for (const Cmd& c : cmds) {
+            switch (c.kind) {
+                case Cmd::Pen:
+                    if (c.down == penDown) break;
+                    penDown = c.down;
+                    fromRest = true;
+                    out.push_back(penDown ? cmdbin::OP_PEN_DOWN : cmdbin::OP_PEN_UP);
+                    head.base.count++;
+                    break;
+                case Cmd::Move:
+                    line(c.x, c.y, out, head.base);
+                    break;
+                case Cmd::Arc:
+                    arc(c, out, head.base);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        cmdbin::encodeCompiledHeader(head, out.data());
+        return true;
+    }
+
+    int blocks = 0;
+    int fallbacks() const { return ik.fallbacks; }
+
+private:
+    void line(double x, double y, std::vector<uint8_t>& out, cmdbin::Header& h) {
+        const double dx = x - posX, dy = y - posY;
+        const double len = kin::length(dx, dy);
+        const int n = std::max(1, (int)ceil(len / prm.segmentMM));
+        const double sx = posX, sy = posY;
+        for (int k = 1; k <= n; k++) {
+            const double t = (double)k / n;
+            block(sx + dx * t, sy + dy * t, out, h);
+        }
+    }
+
+    // Same sweep convention as the Runner: cw turns negative.
+    void arc(const Cmd& c, std::vector<uint8_t>& out, cmdbin::Header& h) {
+        const double cx = posX + c.i, cy = posY + c.j;
+        const double rs = kin::length(posX - cx, posY - cy);
+        const double re = kin::length(c.x - cx, c.y - cy);
+        if (rs < 1e-6 || fabs(rs - re) > 0.25) {
+            line(c.x, c.y, out, h);
+            return;
+        }
+        const double a0 = atan2(posY - cy, posX - cx);
+        const double a1 = atan2(c.y - cy, c.x - cx);
+        double da = a1 - a0;
+        if (c.cw) {
+            if (da >= 0) da -= 2.0 * PI_D;
+        } else {
+            if (da <= 0) da += 2.0 * PI_D;
+        }
+
+        double step = 2.0 * acos(std::max(-1.0, std::min(1.0, 1.0 - prm.arcTolerance / rs)));
+        step = std::min(step, prm.segmentMM / rs);
+        if (!(step > 1e-6)) step = 2.0 * PI_D / 360.0;
+        const int n = std::max(1, std::min(4096, (int)ceil(fabs(da) / step)));
+        for (int k = 1; k < n; k++) {
+            const double a = a0 + da * k / n;
+            block(cx + rs * cos(a), cy + rs * sin(a), out, h);
+        }
+        block(c.x, c.y, out, h);
+    }
+
+    void block(double x, double y, std::vector<uint8_t>& out, cmdbin::Header& h) {
+        long l, r;
+        ik.steps(x, y, l, r);
+        const long dL = l - beltL, dR = r - beltR;
+        const int32_t ux = cmdbin::toUnits(x), uy = cmdbin::toUnits(y);
+        if (dL == 0 && dR == 0) return;   // the point moves into the next block
+
+        const double len = kin::length((ux - unitX) * cmdbin::UNIT, (uy - unitY) * cmdbin::UNIT);
+        const long maxDelta = std::max(labs(dL), labs(dR));
+        const double lenMM = (len > 1e-6) ? len : maxDelta / ik.stepsPerMM;
+        const double mmPerPathStep = lenMM / (double)maxDelta;
+
+        double vNom = penDown ? prm.printSpeed : prm.moveSpeed;
+        vNom = std::min(vNom, prm.maxStepRate * mmPerPathStep);
+        double vJunction = 0.0;
+        if (!fromRest) {
+            vJunction = std::min(vNom, beltJunctionSpeed((double)lastDL, (double)lastDR, (double)dL, (double)dR, lenMM,
+                                                          prm.accelSteps, prm.junctionDeviation, ik.stepsPerMM));
+        }
+
+        uint8_t rec[cmdbin::MAX_RECORD];
+        size_t n = 0;
+        rec[n++] = cmdbin::OP_BELT;
+        n += cmdbin::putVarint(rec + n, ux - unitX);
+        n += cmdbin::putVarint(rec + n, uy - unitY);
+        n += cmdbin::putVarint(rec + n, (int32_t)dL);
+        n += cmdbin::putVarint(rec + n, (int32_t)dR);
+        n += cmdbin::putVarint(rec + n, (int32_t)lround(vNom / cmdbin::SPEED_UNIT));
+        n += cmdbin::putVarint(rec + n, (int32_t)floor(vJunction / cmdbin::SPEED_UNIT));
+        out.insert(out.end(), rec, rec + n);
+        h.count++;
+        blocks++;
+
+        h.minX = std::min(h.minX, ux);
+        h.maxX = std::max(h.maxX, ux);
+        h.minY = std::min(h.minY, uy);
+        h.maxY = std::max(h.maxY, uy);
+
+        posX = x;
+        posY = y;
+        unitX = ux;
+        unitY = uy;
+        beltL = l;
+        beltR = r;
+        lastDL = dL;
+        lastDR = dR;
+        fromRest = false;
+    }
+
+    const Params& prm;
+    BeltSolver<T> ik;
+    double posX = 0.0, posY = 0.0;
+    int32_t unitX = 0, unitY = 0;
+    long beltL = 0, beltR = 0;
+    long lastDL = 0, lastDR = 0;
+    bool penDown = false;
+    bool fromRest = true;
+};
+
+template <typename T>
+int compile(const Params& prm, const std::vector<Cmd>& cmds, double total, double height, const char* outPath,
+            size_t inBytes) {
+    Compiler<T> c(prm);
+    std::vector<uint8_t> out;
+    c.run(cmds, total, height, out);
+
+    FILE* f = fopen(outPath, "wb");
+    if (!f || fwrite(out.data(), 1, out.size(), f) != out.size()) {
+        fprintf(stderr, "beltcompile: cannot write %s\n", outPath);
+        if (f) fclose(f);
+        return 1;
+    }
+    fclose(f);
+
+    printf("%zu commands -> %d belt blocks, %zu -> %zu bytes\n", cmds.size(), c.blocks, inBytes, out.size());
+    if (c.fallbacks() > 0) printf("warning: %d points without a tilt solution (solved level)\n", c.fallbacks());
+    return 0;
+}
+
+void usage() {
+    fprintf(stderr,
+            "usage: beltcompile [options] <commands> <out>\n"
+            "  --diag FILE          machine parameters from a saved /diag JSON\n"
+            "  --top-distance MM    pulley to pulley (required unless in --diag)\n"
+            "  --tcp-x MM --tcp-y MM\n"
+            "  --print-speed MM_S   pen down (default 40)\n"
+            "  --move-speed MM_S    pen up (default 80)\n"
+            "  --accel STEPS_S2     motor acceleration, for the junction speeds\n"
+            "  --junction-dev MM    (default 0.02)\n"
+            "  --max-step-rate N    steps/s per motor (default 4000)\n"
+            "  --seg-mm MM          slice length (default 1)\n"
+            "  --arc-tol MM         arc chord error (default 0.02)\n"
+            "  --kin-float          the firmware is built with VPLOTTER_KIN_FLOAT\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Params prm;
+    const char* in = nullptr;
+    const char* out = nullptr;
+
+    for (int a = 1; a < argc; a++) {
+        const std::string arg = argv[a];
+        auto value = [&](double& v) {
+            if (a + 1 >= argc) {
+                usage();
+                exit(2);
+            }
+            v = atof(argv[++a]);
+        };
+        double v;
+        if (arg == "--diag") {
+            if (a + 1 >= argc || !loadDiag(argv[++a], prm)) {
+                fprintf(stderr, "beltcompile: cannot read the /diag file\n");
+                return 2;
+            }
+        } else if (arg == "--top-distance") { value(prm.topDistance);
+        } else if (arg == "--tcp-x") { value(prm.tcpX);
+        } else if (arg == "--tcp-y") { value(prm.tcpY);
+        } else if (arg == "--print-speed") { value(prm.printSpeed);
+        } else if (arg == "--move-speed") { value(prm.moveSpeed);
+        } else if (arg == "--accel") { value(prm.accelSteps);
+        } else if (arg == "--junction-dev") { value(prm.junctionDeviation);
+        } else if (arg == "--max-step-rate") { value(v); prm.maxStepRate = (int)v;
+        } else if (arg == "--seg-mm") { value(prm.segmentMM);
+        } else if (arg == "--arc-tol") { value(prm.arcTolerance);
+        } else if (arg == "--kin-float") { prm.kinFloat = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            usage();
+            return 2;
+        } else if (!in) {
+            in = argv[a];
+        } else if (!out) {
+            out = argv[a];
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (!in || !out) {
+        usage();
+        return 2;
+    }
+    if (prm.topDistance <= 0.0) {
+        fprintf(stderr, "beltcompile: topDistance unknown, pass --top-distance or --diag\n");
+        return 2;
+    }
+    prm.topDistance = (double)lround(prm.topDistance);   // an int on the plotter
+    prm.segmentMM = std::max(0.1, prm.segmentMM);
+    prm.arcTolerance = std::max(0.001, prm.arcTolerance);
+
+    std::vector<uint8_t> data;
+    if (!readFile(in, data)) {
+        fprintf(stderr, "beltcompile: cannot read %s\n", in);
+        return 1;
+    }
+    std::vector<Cmd> cmds;
+    double total = 0.0, height = 0.0;
+    if (!parseInput(data, cmds, total, height)) {
+        fprintf(stderr, "beltcompile: %s is not a job file\n", in);
+        return 1;
+    }
+
+    if (prm.kinFloat) return compile<float>(prm, cmds, total, height, out, data.size());
+    return compile<double>(prm, cmds, total, height, out, data.size());
+}